@@ -1,5 +1,6 @@
 #include <fstream>
 #include "Vector.hpp"
+#include "Image.hpp"
 #include "Renderer.hpp"
 #include "Scene.hpp"
 #include <optional>
@@ -251,6 +252,11 @@ void Renderer::Render(const Scene& scene)
     // Use this variable as the eye position to start your rays.
     Vector3f eye_pos(0);    //eye_pos is the origin
     int m = 0;
+    // every finished row goes to the stream, whose I/O thread converts and
+    // writes it while the next rows are traced
+    ImageStream output(outputPath, scene.width, scene.height);
+    if (!output.isOpen())
+        std::cerr << "Cannot write " << outputPath << "\n";
     for (int j = 0; j < scene.height; ++j)
     {
         for (int i = 0; i < scene.width; ++i)
@@ -271,25 +277,13 @@ void Renderer::Render(const Scene& scene)
             dir = normalize(dir);
             framebuffer[m++] = castRay(eye_pos, dir, scene, 0); //m++: first take its value and add 1
         }
+        output.add(0, j, scene.width, j + 1,
+                   std::vector<Vector3f>(framebuffer.begin() + j * scene.width,
+                                         framebuffer.begin() + (j + 1) * scene.width));
         UpdateProgress(j / (float)scene.height);
     }
 
-    // save framebuffer to file
-    // ppm file: ppm is a useful image format(Portable Pixelmap)
-    // what's inside ppm?
-    // 　　P6\n
-    // 　　width height\n
-    // 　　255\n
-    // 　　rgbrgb...
-    // use fopen with binary write mode
-    FILE* fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        color[0] = (char)(255 * clamp(0, 1, framebuffer[i].x));
-        color[1] = (char)(255 * clamp(0, 1, framebuffer[i].y));
-        color[2] = (char)(255 * clamp(0, 1, framebuffer[i].z));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+    // wait for the last rows to be written, see ImageStream for the formats
+    if (output.isOpen() && !output.finish())
+        std::cerr << "Cannot write " << outputPath << "\n";
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include "Scene.hpp"
 
 struct hit_payload
@@ -11,8 +12,11 @@ struct hit_payload
 };
 
 class Renderer
-{//no member variable for data, no customized constructors
+{//only the output path as member variable, no customized constructors
 public:
+    // a .pfm path keeps the float framebuffer instead of 8-bit PPM, - is stdout
+    std::string outputPath = "binary.ppm";
+
     void Render(const Scene& scene);
 
 private:
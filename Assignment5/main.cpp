@@ -3,12 +3,20 @@
 #include "Triangle.hpp"
 #include "Light.hpp"
 #include "Renderer.hpp"
+#include "Image.hpp"
 
 // In the main function of the program, we create the scene (create objects and lights)
 // as well as set the options for the render (image width and height, maximum recursion
 // depth, field-of-view, etc.). We then call the render function().
-int main()
+int main(int argc, char** argv)
 {
+    Renderer r;
+    // optional argument: output path, - streams the image to stdout
+    if (argc > 1)
+        r.outputPath = argv[1];
+    if (r.outputPath == "-")
+        imageStdout();
+
     Scene scene(1280, 960);
     //C++17 feature: make_unique, return unique_ptr
     //the constructor of sphere will be called
@@ -44,7 +52,6 @@ int main()
     scene.Add(std::make_unique<Light>(Vector3f(-20, 70, 20), 0.5));
     scene.Add(std::make_unique<Light>(Vector3f(30, 50, -12), 0.5));    
 
-    Renderer r;
     r.Render(scene);
 
     return 0;
@@ -25,6 +25,70 @@ BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
         hrs, mins, secs);
 }
 
+int BVHAccel::splitSAH(std::vector<Object*>& objects, const Bounds3& bounds,
+                       const Bounds3& centroidBounds, int dim) const
+{
+    //binned SAH: drop the centroids into equally sized buckets along dim and
+    //evaluate the cost of splitting at every bucket boundary
+    //cost = traversal + (N_left * S_left + N_right * S_right) / S_node
+    constexpr int nBuckets = 12;
+    struct BucketInfo {
+        int count = 0;
+        Bounds3 bounds;
+    };
+    BucketInfo buckets[nBuckets];
+    auto bucketOf = [&](Object* object) {
+        const Vector3f offset =
+            centroidBounds.Offset(object->getBounds().Centroid());
+        int b = (int)(nBuckets * offset[dim]);
+        return std::min(std::max(b, 0), nBuckets - 1);
+    };
+    for (Object* object : objects) {
+        int b = bucketOf(object);
+        buckets[b].count++;
+        buckets[b].bounds = Union(buckets[b].bounds, object->getBounds());
+    }
+
+    //sweep from the right for the right-hand side of every boundary,
+    //then from the left to finish the cost
+    float rightArea[nBuckets - 1];
+    int rightCount[nBuckets - 1];
+    Bounds3 boundsAbove;
+    int countAbove = 0;
+    for (int i = nBuckets - 1; i > 0; --i) {
+        boundsAbove = Union(boundsAbove, buckets[i].bounds);
+        countAbove += buckets[i].count;
+        rightArea[i - 1] = countAbove ? boundsAbove.SurfaceArea() : 0;
+        rightCount[i - 1] = countAbove;
+    }
+    const float traversalCost = 0.125f;
+    float minCost = std::numeric_limits<float>::max();
+    int minCostSplitBucket = -1;
+    Bounds3 boundsBelow;
+    int countBelow = 0;
+    for (int i = 0; i < nBuckets - 1; ++i) {
+        boundsBelow = Union(boundsBelow, buckets[i].bounds);
+        countBelow += buckets[i].count;
+        if (countBelow == 0 || rightCount[i] == 0)
+            continue;
+        float cost = traversalCost +
+                     (countBelow * boundsBelow.SurfaceArea() +
+                      rightCount[i] * rightArea[i]) / bounds.SurfaceArea();
+        if (cost < minCost) {
+            minCost = cost;
+            minCostSplitBucket = i;
+        }
+    }
+    //all centroids fall into one bucket, any split is as good as another
+    if (minCostSplitBucket < 0)
+        return objects.size() / 2;
+
+    auto mid = std::partition(objects.begin(), objects.end(), [&](Object* object) {
+        return bucketOf(object) <= minCostSplitBucket;
+    });
+    return mid - objects.begin();
+}
+
 BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 {
     BVHBuildNode* node = new BVHBuildNode();
@@ -55,6 +119,12 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
             centroidBounds =
                 Union(centroidBounds, objects[i]->getBounds().Centroid());
         int dim = centroidBounds.maxExtent();   //longest axis to be splited
+        int mid = objects.size() / 2;
+        if (splitMethod == SplitMethod::SAH) {
+            //put the split where the surface area heuristic is cheapest
+            mid = splitSAH(objects, bounds, centroidBounds, dim);
+        }
+        else {
         //check the axis that the objects should be splited, then sort these objects
         switch (dim) {
         case 0:
@@ -76,9 +146,10 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
             });
             break;
         }
+        }
 
         auto beginning = objects.begin();
-        auto middling = objects.begin() + (objects.size() / 2);
+        auto middling = objects.begin() + mid;
         auto ending = objects.end();
 
         auto leftshapes = std::vector<Object*>(beginning, middling);
@@ -130,4 +201,25 @@ Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
     Intersection inter_left = getIntersection(node->left, ray);
     Intersection inter_right = getIntersection(node->right,ray);
     return inter_left.distance < inter_right.distance ? inter_left : inter_right;
-}
\ No newline at end of file
+}
+
+bool BVHAccel::IntersectP(const Ray& ray, float tMax) const
+{
+    if (!root)
+        return false;
+    std::array<int, 3> dirIsNeg = {int(ray.direction.x >0),int(ray.direction.y>0),int(ray.direction.z>0)};
+    Vector3f invDir(1.0f/ray.direction.x,1.0f/ray.direction.y,1.0f/ray.direction.z);
+    return IntersectP(root, ray, invDir, dirIsNeg, tMax);
+}
+
+bool BVHAccel::IntersectP(BVHBuildNode* node, const Ray& ray, const Vector3f& invDir,
+                          const std::array<int, 3>& dirIsNeg, float tMax) const
+{
+    if (node == nullptr || !node->bounds.IntersectP(ray, invDir, dirIsNeg))
+        return false;
+    if (node->left == nullptr && node->right == nullptr)
+        return node->object->hasIntersection(ray, tMax);
+    //any hit will do, the right subtree is skipped once the left one is blocked
+    return IntersectP(node->left, ray, invDir, dirIsNeg, tMax) ||
+           IntersectP(node->right, ray, invDir, dirIsNeg, tMax);
+}
@@ -34,11 +34,16 @@ public:
 
     Intersection Intersect(const Ray &ray) const;
     Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
-    bool IntersectP(const Ray &ray) const;
+    // true if anything is hit with 0 < t < tMax, returns at the first hit
+    bool IntersectP(const Ray &ray, float tMax) const;
+    bool IntersectP(BVHBuildNode* node, const Ray& ray, const Vector3f& invDir,
+                    const std::array<int, 3>& dirIsNeg, float tMax) const;
     BVHBuildNode* root;
 
     // BVHAccel Private Methods
     BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    int splitSAH(std::vector<Object*>& objects, const Bounds3& bounds,
+                 const Bounds3& centroidBounds, int dim) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
@@ -0,0 +1,308 @@
+//
+// Image output: 8-bit binary PPM or float PFM, written at once or streamed
+// while the image is rendered.
+//
+#pragma once
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Vector.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// The pixel buffers are read as one flat array of floats.
+static_assert(sizeof(Vector3f) == 3 * sizeof(float), "Vector3f must be three packed floats");
+
+enum class ImageFormat
+{
+    PPM,
+    PFM
+};
+
+// .pfm keeps the linear float values, anything else is written as PPM;
+// "-" is standard output
+inline ImageFormat imageFormat(const std::string& path)
+{
+    size_t n = path.size();
+    return n >= 4 && (path.compare(n - 4, 4, ".pfm") == 0 || path.compare(n - 4, 4, ".PFM") == 0)
+               ? ImageFormat::PFM
+               : ImageFormat::PPM;
+}
+
+// Converts linear values to bytes as 255 * clamp(c, 0, 1)^exponent, truncated
+// like the per-pixel conversion it replaces. An exponent of 1 is computed
+// directly. Otherwise pow is evaluated once per table entry, at the centre
+// of the range of values it covers; a few values next to a byte boundary may
+// then come out one lower or higher than with pow.
+class GammaTable
+{
+public:
+    static constexpr int Size = 1 << 14;
+
+    explicit GammaTable(float exponent = 1.0f) : exponent(exponent)
+    {
+        if (exponent == 1.0f)
+            return;
+        table.resize(Size);
+        for (int k = 0; k < Size; ++k)
+            table[k] = (uint8_t)(255 * std::pow((k + 0.5f) / Size, exponent));
+    }
+
+    // count floats from src to count bytes in dst
+    void encode(const float* src, uint8_t* dst, size_t count) const
+    {
+        if (table.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                float c = src[i] > 0.0f ? (src[i] < 1.0f ? src[i] : 1.0f) : 0.0f;
+                dst[i] = (uint8_t)(255 * c);
+            }
+            return;
+        }
+        const uint8_t* lut = table.data();
+        for (size_t i = 0; i < count; ++i) {
+            float c = src[i] > 0.0f ? (src[i] < 1.0f ? src[i] : 1.0f) : 0.0f;
+            int k = (int)(c * Size);
+            dst[i] = lut[k < Size ? k : Size - 1];
+        }
+    }
+
+    float exponent;
+
+private:
+    std::vector<uint8_t> table;
+};
+
+// Header of an image file; the pixel data follows it directly.
+inline std::string imageHeader(ImageFormat format, int width, int height)
+{
+    char header[64];
+    if (format == ImageFormat::PPM) {
+        snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    }
+    else {
+        // a negative scale marks little-endian floats
+        const uint16_t one = 1;
+        bool littleEndian = *(const uint8_t*)&one == 1;
+        snprintf(header, sizeof(header), "PF\n%d %d\n%s\n", width, height,
+                 littleEndian ? "-1.0" : "1.0");
+    }
+    return header;
+}
+
+// Stream on the original standard output for writing an image to "-". The
+// first call redirects the standard output of the process to stderr, so
+// that text printed afterwards cannot end up in the image; call it before
+// anything is printed.
+inline FILE* imageStdout()
+{
+    static FILE* out = [] {
+        fflush(stdout);
+#ifdef _WIN32
+        int fd = _dup(_fileno(stdout));
+        _dup2(_fileno(stderr), _fileno(stdout));
+        _setmode(fd, _O_BINARY);
+        return _fdopen(fd, "wb");
+#else
+        int fd = dup(fileno(stdout));
+        dup2(fileno(stderr), fileno(stdout));
+        return fdopen(fd, "wb");
+#endif
+    }();
+    return out;
+}
+
+inline FILE* openImageFile(const std::string& path)
+{
+    return path == "-" ? imageStdout() : fopen(path.c_str(), "wb");
+}
+
+// closes a file from openImageFile(path), true if everything written to it
+// reached the file; standard output is only flushed
+inline bool closeImageFile(FILE* fp, const std::string& path)
+{
+    return path == "-" ? fflush(fp) == 0 : fclose(fp) == 0;
+}
+
+// Writes width x height linear RGB pixels, stored top row first, to path.
+// The file is assembled in memory and written with a single fwrite. PPM
+// channels go through gamma; PFM stores the raw floats, bottom row first as
+// the format requires, so nothing is quantized for later processing.
+inline bool writeImage(const std::string& path, const std::vector<Vector3f>& pixels, int width,
+                       int height, const GammaTable& gamma = GammaTable())
+{
+    ImageFormat format = imageFormat(path);
+    std::string header = imageHeader(format, width, height);
+    size_t count = (size_t)width * height * 3;
+    size_t pixelBytes = format == ImageFormat::PPM ? count : count * sizeof(float);
+    std::vector<uint8_t> buffer(header.size() + pixelBytes);
+    std::memcpy(buffer.data(), header.data(), header.size());
+    uint8_t* dst = buffer.data() + header.size();
+    const float* src = reinterpret_cast<const float*>(pixels.data());
+    if (format == ImageFormat::PPM) {
+        gamma.encode(src, dst, count);
+    }
+    else {
+        size_t rowBytes = (size_t)width * 3 * sizeof(float);
+        for (int j = 0; j < height; ++j)
+            std::memcpy(dst + (size_t)(height - 1 - j) * rowBytes, src + (size_t)j * width * 3,
+                        rowBytes);
+    }
+
+    FILE* fp = openImageFile(path);
+    if (!fp)
+        return false;
+    bool ok = fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+    return closeImageFile(fp, path) && ok;
+}
+
+// Writes an image while it is still being rendered. The renderer hands over
+// every finished block of pixels with add(); a separate I/O thread converts
+// them and writes each row of the file once it and all rows before it are
+// complete, so output overlaps with rendering and a reader on the other end
+// of a pipe can start early. PFM stores the bottom row first, its rows are
+// therefore only written once the bottom of the image is done.
+class ImageStream
+{
+public:
+    ImageStream(const std::string& path, int width, int height,
+                const GammaTable& gamma = GammaTable())
+        : path(path), format(imageFormat(path)), width(width), height(height), gamma(gamma),
+          fp(openImageFile(path)), rowPixels(height, 0)
+    {
+        if (!fp)
+            return;
+        std::string header = imageHeader(format, width, height);
+        failed = fwrite(header.data(), 1, header.size(), fp) != header.size();
+        rowBytes = (size_t)width * 3 * (format == ImageFormat::PPM ? 1 : sizeof(float));
+        encoded.resize(rowBytes * height);
+        worker = std::thread([this] { run(); });
+    }
+
+    ~ImageStream() { finish(); }
+
+    ImageStream(const ImageStream&) = delete;
+    ImageStream& operator=(const ImageStream&) = delete;
+
+    bool isOpen() const { return fp != nullptr; }
+
+    // The linear pixels of [x0, x1) x [y0, y1), row by row. Every pixel of
+    // the image must be added once. Can be called from any thread.
+    void add(int x0, int y0, int x1, int y1, std::vector<Vector3f> pixels)
+    {
+        if (!fp)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back({x0, y0, x1, y1, std::move(pixels)});
+        }
+        ready.notify_one();
+    }
+
+    // Writes what is left, pixels that were never added as black, and closes
+    // the file. Returns false if anything could not be written.
+    bool finish()
+    {
+        if (!fp)
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        ready.notify_one();
+        worker.join();
+        writeRows(height);
+        bool ok = closeImageFile(fp, path) && !failed;
+        fp = nullptr;
+        return ok;
+    }
+
+private:
+    struct Block
+    {
+        int x0, y0, x1, y1;
+        std::vector<Vector3f> pixels;
+    };
+
+    void run()
+    {
+        std::deque<Block> blocks;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return !queue.empty() || closing; });
+                if (queue.empty())
+                    return;
+                blocks.swap(queue);
+            }
+            for (const Block& block : blocks)
+                encode(block);
+            blocks.clear();
+            // image row y is file row y for PPM and height - 1 - y for PFM
+            int complete = nextRow;
+            while (complete < height &&
+                   rowPixels[format == ImageFormat::PPM ? complete : height - 1 - complete] ==
+                       width)
+                complete++;
+            writeRows(complete);
+        }
+    }
+
+    void encode(const Block& block)
+    {
+        int w = block.x1 - block.x0;
+        const float* src = reinterpret_cast<const float*>(block.pixels.data());
+        for (int y = block.y0; y < block.y1; ++y, src += w * 3) {
+            int fileRow = format == ImageFormat::PPM ? y : height - 1 - y;
+            uint8_t* dst = encoded.data() + fileRow * rowBytes;
+            if (format == ImageFormat::PPM)
+                gamma.encode(src, dst + block.x0 * 3, w * 3);
+            else
+                std::memcpy(dst + block.x0 * 3 * sizeof(float), src, w * 3 * sizeof(float));
+            rowPixels[y] += w;
+        }
+    }
+
+    // writes the file rows from nextRow up to end
+    void writeRows(int end)
+    {
+        if (end <= nextRow)
+            return;
+        size_t bytes = (end - nextRow) * rowBytes;
+        if (fwrite(encoded.data() + nextRow * rowBytes, 1, bytes, fp) != bytes || fflush(fp) != 0)
+            failed = true;
+        nextRow = end;
+    }
+
+    std::string path;
+    ImageFormat format;
+    int width, height;
+    GammaTable gamma;
+    FILE* fp;
+    bool failed = false;
+    size_t rowBytes = 0;
+    // the whole image in file layout, filled in as blocks arrive
+    std::vector<uint8_t> encoded;
+    // pixels added so far to every image row
+    std::vector<int> rowPixels;
+    // first file row not written yet
+    int nextRow = 0;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Block> queue;
+    bool closing = false;
+    std::thread worker;
+};
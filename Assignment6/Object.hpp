@@ -23,6 +23,9 @@ public:
     Object() {}
     virtual ~Object() {}
     virtual Intersection getIntersection(Ray _ray) = 0;
+    // occlusion query: true if the ray hits anything with 0 < t < tMax,
+    // stops at the first hit found instead of looking for the closest one
+    virtual bool hasIntersection(const Ray& ray, float tMax) = 0;
     virtual Vector3f evalDiffuseColor() const =0;
     virtual Bounds3 getBounds()=0;
 };
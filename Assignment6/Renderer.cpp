@@ -4,6 +4,7 @@
 
 #include <fstream>
 #include "Scene.hpp"
+#include "Image.hpp"
 #include "Renderer.hpp"
 
 
@@ -22,6 +23,11 @@ void Renderer::Render(const Scene& scene)
     float imageAspectRatio = scene.width / (float)scene.height;
     Vector3f eye_pos(-1, 5, 10);
     int m = 0;
+    // every finished row goes to the stream, whose I/O thread converts and
+    // writes it while the next rows are traced
+    ImageStream output(outputPath, scene.width, scene.height);
+    if (!output.isOpen())
+        std::cerr << "Cannot write " << outputPath << "\n";
     for (uint32_t j = 0; j < scene.height; ++j) {
         for (uint32_t i = 0; i < scene.width; ++i) {
             // generate primary ray direction
@@ -38,19 +44,14 @@ void Renderer::Render(const Scene& scene)
             Ray ray(eye_pos, dir);
             framebuffer[m++] = scene.castRay(ray, 0);
         }
+        output.add(0, j, scene.width, j + 1,
+                   std::vector<Vector3f>(framebuffer.begin() + j * scene.width,
+                                         framebuffer.begin() + (j + 1) * scene.width));
         UpdateProgress(j / (float)scene.height);
     }
     UpdateProgress(1.f);
 
-    // save framebuffer to file
-    FILE* fp = fopen("../images/binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].x));
-        color[1] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].y));
-        color[2] = (unsigned char)(255 * clamp(0, 1, framebuffer[i].z));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+    // wait for the last rows to be written, see ImageStream for the formats
+    if (output.isOpen() && !output.finish())
+        std::cerr << "Cannot write " << outputPath << "\n";
 }
@@ -1,15 +1,19 @@
 //
 // Created by goksu on 2/25/20.
 //
+#include <string>
 #include "Scene.hpp"
 
 #pragma once
 
 class Renderer
 {
-//no data inside this class
+//no scene data inside this class
 //instead, we pass in the reference of scene and render it directly
 public:
+    // a .pfm path keeps the float framebuffer instead of 8-bit PPM, - is stdout
+    std::string outputPath = "../images/binary.ppm";
+
     void Render(const Scene& scene);
 
 private:
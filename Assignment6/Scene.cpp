@@ -5,9 +5,9 @@
 #include "Scene.hpp"
 
 
-void Scene::buildBVH() {
+void Scene::buildBVH(BVHAccel::SplitMethod splitMethod) {
     printf(" - Generating BVH...\n\n");
-    this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    this->bvh = new BVHAccel(objects, 1, splitMethod);
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -19,6 +19,11 @@ Intersection Scene::intersect(const Ray &ray) const
     return this->bvh->Intersect(ray);
 }
 
+bool Scene::intersectP(const Ray &ray, float tMax) const
+{
+    return this->bvh->IntersectP(ray, tMax);
+}
+
 // Implementation of the Whitted-syle light transport algorithm (E [S*] (D|G) L)
 //
 // This function is the function that compute the color at the intersection point
@@ -109,11 +114,8 @@ Vector3f Scene::castRay(const Ray &ray, int depth) const
                         float lightDistance2 = dotProduct(lightDir, lightDir);
                         lightDir = normalize(lightDir);
                         float LdotN = std::max(0.f, dotProduct(lightDir, N));
-                        Object *shadowHitObject = nullptr;
-                        float tNearShadow = kInfinity;
-                        // is the point in shadow, and is the nearest occluding object closer to the object than the light itself?
-                        Intersection test = bvh->Intersect(Ray(shadowPointOrig, lightDir));
-                        bool inShadow = test.happened && (test.distance < lightDistance2);
+                        // is the point in shadow, is anything between the point and the light?
+                        bool inShadow = intersectP(Ray(shadowPointOrig, lightDir), std::sqrt(lightDistance2));
                         //intensity * LdotN is measuring the direct light intensity by cosine law
                         lightAmt += (1 - inShadow) * get_lights()[i]->intensity * LdotN;
                         Vector3f reflectionDirection = reflect(-lightDir, N);
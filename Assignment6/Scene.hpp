@@ -32,9 +32,11 @@ public:
     const std::vector<Object*>& get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
+    // occlusion query for shadow rays, true if anything is hit before tMax
+    bool intersectP(const Ray& ray, float tMax) const;
     
     BVHAccel *bvh;
-    void buildBVH();
+    void buildBVH(BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE);
     
     Vector3f castRay(const Ray &ray, int depth) const;
     bool trace(const Ray &ray, const std::vector<Object*> &objects, float &tNear, uint32_t &index, Object **hitObject);
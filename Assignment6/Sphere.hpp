@@ -38,6 +38,17 @@ public:
         return result;
     }
 
+    bool hasIntersection(const Ray& ray, float tMax){
+        Vector3f L = ray.origin - center;
+        float a = dotProduct(ray.direction, ray.direction);
+        float b = 2 * dotProduct(ray.direction, L);
+        float c = dotProduct(L, L) - radius2;
+        float t0, t1;
+        if (!solveQuadratic(a, b, c, t0, t1)) return false;
+        if (t0 < 0) t0 = t1;
+        return t0 >= 0 && t0 < tMax;
+    }
+
     Vector3f evalDiffuseColor()const {
         return m->getColor();
     }
@@ -28,8 +28,13 @@ public:
         normal = normalize(crossProduct(e1, e2));
     }
 
+    // Moller Trumbore, on a hit t is the ray parameter
+    bool intersectRay(const Ray& ray, double& t) const;
+
     Intersection getIntersection(Ray ray) override;
 
+    bool hasIntersection(const Ray& ray, float tMax) override;
+
     Vector3f evalDiffuseColor() const override;
     
     Bounds3 getBounds() override;
@@ -38,7 +43,8 @@ public:
 class MeshTriangle : public Object
 {
 public:
-    MeshTriangle(const std::string& filename)
+    MeshTriangle(const std::string& filename,
+                 BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE)
     {
         numTriangles = 0;
         objl::Loader loader;
@@ -87,7 +93,7 @@ public:
         std::vector<Object*> ptrs;
         for (auto& tri : triangles)
             ptrs.push_back(&tri);
-        bvh = new BVHAccel(ptrs);
+        bvh = new BVHAccel(ptrs, 1, splitMethod);
     }
 
     Bounds3 getBounds() { return bounding_box; }
@@ -105,6 +111,11 @@ public:
         return intersec;
     }
 
+    bool hasIntersection(const Ray& ray, float tMax)
+    {
+        return bvh && bvh->IntersectP(ray, tMax);
+    }
+
     //the bounding box of MeshTriangle will be processed together with spheres and the
     //bvh tree inside the scene will store these data
     //for triangles inside the mesh, their bounding boxes will be processed with other small triangles
@@ -120,31 +131,37 @@ public:
 
 inline Bounds3 Triangle::getBounds() { return Union(Bounds3(v0, v1), v2); }
 
-inline Intersection Triangle::getIntersection(Ray ray)
+inline bool Triangle::intersectRay(const Ray& ray, double& t) const
 {
-    Intersection inter;
     //implement Moller Trumbore Algorithm
     if (dotProduct(ray.direction, normal) > 0)
-        return inter;
-    double u, v, t_tmp = 0;
+        return false;
+    double u, v;
     Vector3f pvec = crossProduct(ray.direction, e2);
     double det = dotProduct(e1, pvec);
     if (fabs(det) < EPSILON)
-        return inter;
+        return false;
 
     double det_inv = 1. / det;
     Vector3f tvec = ray.origin - v0;
     u = dotProduct(tvec, pvec) * det_inv;
     if (u < 0 || u > 1)
-        return inter;
+        return false;
     Vector3f qvec = crossProduct(tvec, e1);
     v = dotProduct(ray.direction, qvec) * det_inv;
     if (v < 0 || u + v > 1)
-        return inter;
-    t_tmp = dotProduct(e2, qvec) * det_inv;
+        return false;
+    t = dotProduct(e2, qvec) * det_inv;
+    return t > 0;
+}
+
+inline Intersection Triangle::getIntersection(Ray ray)
+{
+    Intersection inter;
+    double t_tmp = 0;
 
     // TODO find ray triangle intersection
-    if (t_tmp>0){
+    if (intersectRay(ray, t_tmp)){
         // fill in the info. of Intersection
         // bool happened;
         // Vector3f coords;
@@ -163,6 +180,12 @@ inline Intersection Triangle::getIntersection(Ray ray)
     return inter;
 }
 
+inline bool Triangle::hasIntersection(const Ray& ray, float tMax)
+{
+    double t;
+    return intersectRay(ray, t) && t < tMax;
+}
+
 inline Vector3f Triangle::evalDiffuseColor() const
 {
     return Vector3f(0.5, 0.5, 0.5);
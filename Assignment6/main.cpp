@@ -1,3 +1,4 @@
+#include "Image.hpp"
 #include "Renderer.hpp"
 #include "Scene.hpp"
 #include "Triangle.hpp"
@@ -11,18 +12,23 @@
 // function().
 int main(int argc, char** argv)
 {
+    Renderer r;
+    // optional argument: output path, - streams the image to stdout
+    if (argc > 1)
+        r.outputPath = argv[1];
+    if (r.outputPath == "-")
+        imageStdout();
+
     Scene scene(1280, 960);
 
     //two bvh will be built, one belongs to the scene, one belongs to the MeshTriangles
     //in this project, no spheres will be added, so the bvh for scene only contains one root which is the MeshTriangle
     //in the MeshTriangle which reads the triagles information from object_loader, another bvh takes in charge of all the triangles
-    MeshTriangle bunny("../models/bunny/bunny.obj");
+    MeshTriangle bunny("../models/bunny/bunny.obj", BVHAccel::SplitMethod::SAH);
     scene.Add(&bunny);
     scene.Add(std::make_unique<Light>(Vector3f(-20, 70, 20), 1));
     scene.Add(std::make_unique<Light>(Vector3f(20, 70, 20), 1));
-    scene.buildBVH();
-
-    Renderer r;
+    scene.buildBVH(BVHAccel::SplitMethod::SAH);
 
     auto start = std::chrono::system_clock::now();
     r.Render(scene);
@@ -0,0 +1,88 @@
+//
+// Walker / Vose alias table: picks one of n items with probability
+// proportional to its weight in O(1), built in O(n).
+//
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+class AliasTable
+{
+public:
+    AliasTable() = default;
+
+    explicit AliasTable(const std::vector<float>& weights)
+    {
+        double sum = 0;
+        for (float w : weights)
+            sum += std::max(w, 0.0f);
+        if (weights.empty() || sum <= 0)
+            return;
+
+        int n = (int)weights.size();
+        bins.resize(n);
+        // scaled probabilities, the average bin holds exactly 1
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (int i = 0; i < n; ++i) {
+            bins[i].pmf = (float)(std::max(weights[i], 0.0f) / sum);
+            scaled[i] = std::max(weights[i], 0.0f) / sum * n;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+        // every small bin is topped up with the excess of a large one
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            large.pop_back();
+            bins[s].threshold = (float)scaled[s];
+            bins[s].alias = l;
+            scaled[l] -= 1 - scaled[s];
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+        // what is left is 1 up to rounding
+        for (int i : small) bins[i].threshold = 1, bins[i].alias = i;
+        for (int i : large) bins[i].threshold = 1, bins[i].alias = i;
+    }
+
+    bool empty() const { return bins.empty(); }
+    int size() const { return (int)bins.size(); }
+    float pmf(int i) const { return bins[i].pmf; }
+
+    // Picks an item with the uniform sample u in [0, 1). The part of u that
+    // was not needed for the choice is returned through remapped, again
+    // uniform in [0, 1), so it can be reused for sampling the item.
+    int sample(float u, float* remapped = nullptr) const
+    {
+        int n = (int)bins.size();
+        float scaled = u * n;
+        int i = std::min((int)scaled, n - 1);
+        // u * n may round up to n; keeping up below 1 means a full bin
+        // (threshold 1) never takes the alias branch and divides by zero
+        float up = std::min(scaled - i, 0x1.fffffep-1f);
+        const Bin& bin = bins[i];
+        int chosen;
+        float r;
+        if (up < bin.threshold) {
+            chosen = i;
+            r = up / bin.threshold;
+        }
+        else {
+            chosen = bin.alias;
+            r = (up - bin.threshold) / (1 - bin.threshold);
+        }
+        if (remapped)
+            *remapped = std::min(r, 0x1.fffffep-1f);
+        return chosen;
+    }
+
+private:
+    struct Bin
+    {
+        // probability of keeping the bin's own item, otherwise alias is used
+        float threshold = 1;
+        int alias = 0;
+        float pmf = 0;
+    };
+    std::vector<Bin> bins;
+};
@@ -19,10 +19,10 @@ public:
         length = 100;
     }
 
-    Vector3f SamplePoint() const
+    Vector3f SamplePoint(const Vector2f &sample) const
     {
-        auto random_u = get_random_float();
-        auto random_v = get_random_float();
+        auto random_u = sample.x;
+        auto random_v = sample.y;
         return position + random_u * u + random_v * v;
     }
 
@@ -1,144 +1,674 @@
 #include <algorithm>
 #include <cassert>
 #include "BVH.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+
+// subtrees with more primitives than this are built as separate pool tasks
+static constexpr int kParallelBuildThreshold = 4096;
+// relative cost of a traversal step compared to one primitive test
+static constexpr float kTraversalCost = 0.125f;
+// entries of the traversal stacks; a wide node pops one entry and pushes up
+// to four, so this bounds the depth of the tree at about 85 wide levels
+static constexpr int kTraversalStackSize = 256;
+
+struct BVHPrimitiveInfo {
+    int primitiveNumber;
+    Bounds3 bounds;
+    Vector3f centroid;
+};
 
 BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
                    SplitMethod splitMethod)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
       primitives(std::move(p))
 {
-    time_t start, stop;
-    time(&start);
-    if (primitives.empty())
-        return;
+    primitiveNumbers.resize(primitives.size());
+    for (size_t i = 0; i < primitives.size(); ++i)
+        primitiveNumbers[i] = (int)i;
+    build();
+}
 
-    root = recursiveBuild(primitives);
+BVHAccel::BVHAccel(std::shared_ptr<const TriangleMesh> m, int maxPrimsInNode,
+                   SplitMethod splitMethod)
+    : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
+      mesh(std::move(m))
+{
+    build();
+}
 
-    time(&stop);
-    double diff = difftime(stop, start);
-    int hrs = (int)diff / 3600;
-    int mins = ((int)diff / 60) - (hrs * 60);
-    int secs = (int)diff - (hrs * 3600) - (mins * 60);
+BVHAccel::BVHAccel(std::shared_ptr<const TriangleMesh> m,
+                   std::vector<LinearBVHNode> prebuiltNodes,
+                   std::vector<int> leafOrder, int maxPrimsInNode,
+                   SplitMethod splitMethod)
+    : maxPrimsInNode(std::min(255, maxPrimsInNode)), splitMethod(splitMethod),
+      mesh(std::move(m)), primitiveNumbers(std::move(leafOrder)),
+      nodes(std::move(prebuiltNodes))
+{
+    totalNodes = (int)nodes.size();
+    if (totalNodes == 0)
+        return;
+    // only the derived traversal data is rebuilt
+    buildTrianglePackets();
+    wideNodes.reserve(totalNodes / 2 + 1);
+    collapseBVH4(0);
+    builtCost = sahCost();
+}
 
-    printf(
-        "\rBVH Generation complete: \nTime Taken: %i hrs, %i mins, %i secs\n\n",
-        hrs, mins, secs);
+Bounds3 BVHAccel::primitiveBounds(int i) const
+{
+    return mesh ? mesh->bounds(primitiveNumbers[i]) : primitives[i]->getBounds();
 }
 
-BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
+void BVHAccel::build()
 {
-    BVHBuildNode* node = new BVHBuildNode();
+    stats::ScopedTimer timer("bvh_build");
+    nodes.clear();
+    wideNodes.clear();
+    totalNodes = 0;
+    int n = mesh ? (int)mesh->size() : (int)primitives.size();
+    if (mesh)
+        primitiveNumbers.resize(n);
+    if (n == 0)
+        return;
 
-    // Compute bounds of all primitives in BVH node
-    Bounds3 bounds;
-    for (int i = 0; i < objects.size(); ++i)
-        bounds = Union(bounds, objects[i]->getBounds());
-    if (objects.size() == 1) {
-        // Create leaf _BVHBuildNode_
-        node->bounds = objects[0]->getBounds();
-        node->object = objects[0];
-        node->left = nullptr;
-        node->right = nullptr;
-        node->area = objects[0]->getArea();
-        return node;
-    }
-    else if (objects.size() == 2) {
-        node->left = recursiveBuild(std::vector{objects[0]});
-        node->right = recursiveBuild(std::vector{objects[1]});
-
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
-        return node;
+    // query the bounds of every primitive once up front, the build only
+    // moves these records around in place
+    std::vector<BVHPrimitiveInfo> primitiveInfo(n);
+    ThreadPool& pool = globalThreadPool();
+    {
+        TaskGroup group(pool);
+        for (int begin = 0; begin < n; begin += kParallelBuildThreshold) {
+            int end = std::min(begin + kParallelBuildThreshold, n);
+            group.run([&, begin, end] {
+                for (int i = begin; i < end; ++i) {
+                    primitiveInfo[i].primitiveNumber = i;
+                    primitiveInfo[i].bounds =
+                        mesh ? mesh->bounds(i) : primitives[i]->getBounds();
+                    primitiveInfo[i].centroid = primitiveInfo[i].bounds.Centroid();
+                }
+            });
+        }
+        group.wait();
+    }
+
+    // a binary tree over n primitives never has more than 2n - 1 nodes
+    std::vector<BVHBuildNode> buildNodes(2 * n - 1);
+    std::atomic<int> nodeCount{0};
+    BVHBuildNode* root = recursiveBuild(primitiveInfo, 0, n, buildNodes, nodeCount);
+    totalNodes = nodeCount.load();
+
+    // flatten the build tree into the compact depth-first node array
+    nodes.resize(totalNodes);
+    int offset = 0;
+    flattenBVHTree(root, &offset);
+    assert(offset == totalNodes);
+
+    // leaves reference ranges of primitiveInfo. A mesh BVH maps them to
+    // triangles, an object BVH reorders its primitives to match and keeps
+    // track of their index in the constructor's list.
+    if (mesh) {
+        for (int i = 0; i < n; ++i)
+            primitiveNumbers[i] = primitiveInfo[i].primitiveNumber;
+        buildTrianglePackets();
     }
     else {
-        Bounds3 centroidBounds;
-        for (int i = 0; i < objects.size(); ++i)
-            centroidBounds =
-                Union(centroidBounds, objects[i]->getBounds().Centroid());
-        int dim = centroidBounds.maxExtent();
-        switch (dim) {
-        case 0:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().x <
-                       f2->getBounds().Centroid().x;
-            });
-            break;
-        case 1:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().y <
-                       f2->getBounds().Centroid().y;
-            });
-            break;
-        case 2:
-            std::sort(objects.begin(), objects.end(), [](auto f1, auto f2) {
-                return f1->getBounds().Centroid().z <
-                       f2->getBounds().Centroid().z;
-            });
-            break;
+        std::vector<Object*> orderedPrims(n);
+        std::vector<int> orderedNumbers(n);
+        for (int i = 0; i < n; ++i) {
+            orderedPrims[i] = primitives[primitiveInfo[i].primitiveNumber];
+            orderedNumbers[i] = primitiveNumbers[primitiveInfo[i].primitiveNumber];
+        }
+        primitives.swap(orderedPrims);
+        primitiveNumbers.swap(orderedNumbers);
+    }
+
+    // collapse the binary tree into the 4-wide tree used for traversal
+    wideNodes.reserve(totalNodes / 2 + 1);
+    collapseBVH4(0);
+    builtCost = sahCost();
+
+    printf("\rBVH Generation complete: \nTime Taken: %.3f ms\n\n",
+           timer.elapsed() * 1e3);
+}
+
+void BVHAccel::refit()
+{
+    stats::ScopedTimer timer("bvh_refit");
+    if (totalNodes == 0)
+        return;
+    // children follow their parent in the array, so a backwards sweep
+    // updates both children of a node before the node itself
+    for (int i = totalNodes - 1; i >= 0; --i) {
+        LinearBVHNode& node = nodes[i];
+        if (node.nPrimitives > 0) {
+            Bounds3 bounds;
+            for (int k = 0; k < node.nPrimitives; ++k)
+                bounds = Union(bounds, primitiveBounds(node.primitivesOffset + k));
+            node.bounds = bounds;
         }
+        else {
+            node.bounds = Union(nodes[i + 1].bounds, nodes[node.secondChildOffset].bounds);
+        }
+    }
+    if (mesh)
+        buildTrianglePackets();
+    wideNodes.clear();
+    collapseBVH4(0);
+}
 
-        auto beginning = objects.begin();
-        auto middling = objects.begin() + (objects.size() / 2);
-        auto ending = objects.end();
+float BVHAccel::sahCost() const
+{
+    if (totalNodes == 0 || nodes[0].bounds.SurfaceArea() <= 0)
+        return 0;
+    float cost = 0;
+    for (const LinearBVHNode& node : nodes)
+        cost += node.bounds.SurfaceArea() *
+                (node.nPrimitives > 0 ? (float)node.nPrimitives : kTraversalCost);
+    return cost / nodes[0].bounds.SurfaceArea();
+}
 
-        auto leftshapes = std::vector<Object*>(beginning, middling);
-        auto rightshapes = std::vector<Object*>(middling, ending);
+bool BVHAccel::update(float maxCostRatio)
+{
+    refit();
+    if (sahCost() <= maxCostRatio * builtCost)
+        return false;
+    build();
+    return true;
+}
 
-        assert(objects.size() == (leftshapes.size() + rightshapes.size()));
+BVHAccel::~BVHAccel() = default;
 
-        node->left = recursiveBuild(leftshapes);
-        node->right = recursiveBuild(rightshapes);
+Bounds3 BVHAccel::WorldBound() const
+{
+    return nodes.empty() ? Bounds3() : nodes[0].bounds;
+}
 
-        node->bounds = Union(node->left->bounds, node->right->bounds);
-        node->area = node->left->area + node->right->area;
+BVHBuildNode* BVHAccel::createLeaf(BVHBuildNode* node, int start, int end,
+                                   const Bounds3& bounds)
+{
+    // Create leaf _BVHBuildNode_
+    node->bounds = bounds;
+    node->firstPrimOffset = start;
+    node->nPrimitives = end - start;
+    node->left = nullptr;
+    node->right = nullptr;
+    return node;
+}
+
+int BVHAccel::splitSAH(std::vector<BVHPrimitiveInfo>& primitiveInfo, int start,
+                       int end, const Bounds3& bounds,
+                       const Bounds3& centroidBounds, int dim) const
+{
+    // Partition primitives using approximate SAH: bin the centroids into
+    // equally sized buckets along _dim_ and evaluate the split cost at every
+    // bucket boundary
+    constexpr int nBuckets = 12;
+    struct BucketInfo {
+        int count = 0;
+        Bounds3 bounds;
+    };
+    BucketInfo buckets[nBuckets];
+    auto bucketOf = [&](const BVHPrimitiveInfo& info) {
+        const Vector3f offset = centroidBounds.Offset(info.centroid);
+        int b = (int)(nBuckets * offset[dim]);
+        return std::min(std::max(b, 0), nBuckets - 1);
+    };
+    for (int i = start; i < end; ++i) {
+        int b = bucketOf(primitiveInfo[i]);
+        buckets[b].count++;
+        buckets[b].bounds = Union(buckets[b].bounds, primitiveInfo[i].bounds);
+    }
+
+    // sweep from the right to get the cost terms of every right-hand side,
+    // then from the left to finish the cost of each boundary
+    float rightArea[nBuckets - 1];
+    int rightCount[nBuckets - 1];
+    Bounds3 boundsAbove;
+    int countAbove = 0;
+    for (int i = nBuckets - 1; i > 0; --i) {
+        boundsAbove = Union(boundsAbove, buckets[i].bounds);
+        countAbove += buckets[i].count;
+        rightArea[i - 1] = countAbove ? boundsAbove.SurfaceArea() : 0;
+        rightCount[i - 1] = countAbove;
+    }
+    float minCost = std::numeric_limits<float>::max();
+    int minCostSplitBucket = -1;
+    Bounds3 boundsBelow;
+    int countBelow = 0;
+    for (int i = 0; i < nBuckets - 1; ++i) {
+        boundsBelow = Union(boundsBelow, buckets[i].bounds);
+        countBelow += buckets[i].count;
+        if (countBelow == 0 || rightCount[i] == 0)
+            continue;
+        float cost = kTraversalCost +
+                     (countBelow * boundsBelow.SurfaceArea() +
+                      rightCount[i] * rightArea[i]) / bounds.SurfaceArea();
+        if (cost < minCost) {
+            minCost = cost;
+            minCostSplitBucket = i;
+        }
+    }
+
+    // a leaf costs one test per primitive; keep the primitives together if
+    // that is cheaper and they fit into one leaf
+    int nPrimitives = end - start;
+    float leafCost = (float)nPrimitives;
+    if (minCostSplitBucket < 0 ||
+        (nPrimitives <= maxPrimsInNode && leafCost <= minCost))
+        return nPrimitives <= maxPrimsInNode ? -1 : (start + end) / 2;
+
+    auto mid = std::partition(
+        primitiveInfo.begin() + start, primitiveInfo.begin() + end,
+        [&](const BVHPrimitiveInfo& info) {
+            return bucketOf(info) <= minCostSplitBucket;
+        });
+    return (int)(mid - primitiveInfo.begin());
+}
+
+BVHBuildNode* BVHAccel::recursiveBuild(std::vector<BVHPrimitiveInfo>& primitiveInfo,
+                                       int start, int end,
+                                       std::vector<BVHBuildNode>& buildNodes,
+                                       std::atomic<int>& nodeCount)
+{
+    BVHBuildNode* node = &buildNodes[nodeCount.fetch_add(1)];
+
+    // Compute bounds of all primitives in BVH node
+    Bounds3 bounds;
+    for (int i = start; i < end; ++i)
+        bounds = Union(bounds, primitiveInfo[i].bounds);
+    int nPrimitives = end - start;
+    if (nPrimitives == 1) {
+        return createLeaf(node, start, end, bounds);
     }
 
+    Bounds3 centroidBounds;
+    for (int i = start; i < end; ++i)
+        centroidBounds = Union(centroidBounds, primitiveInfo[i].centroid);
+    int dim = centroidBounds.maxExtent();
+    node->splitAxis = dim;
+
+    int mid = (start + end) / 2;
+    if (splitMethod == SplitMethod::NAIVE && nPrimitives <= maxPrimsInNode) {
+        return createLeaf(node, start, end, bounds);
+    }
+    if (splitMethod == SplitMethod::SAH) {
+        mid = splitSAH(primitiveInfo, start, end, bounds, centroidBounds, dim);
+        if (mid < 0)
+            return createLeaf(node, start, end, bounds);
+    }
+    else {
+        // median split: only the element at _mid_ has to end up in sorted
+        // position, everything else merely on the correct side of it
+        std::nth_element(primitiveInfo.begin() + start,
+                         primitiveInfo.begin() + mid,
+                         primitiveInfo.begin() + end,
+                         [dim](const BVHPrimitiveInfo& a, const BVHPrimitiveInfo& b) {
+                             return a.centroid[dim] < b.centroid[dim];
+                         });
+    }
+    assert(start < mid && mid < end);
+
+    // build the two halves of large nodes in parallel; the calling thread
+    // builds the right subtree while the pool picks up the left one
+    if (nPrimitives > kParallelBuildThreshold) {
+        TaskGroup group(globalThreadPool());
+        group.run([&] {
+            node->left = recursiveBuild(primitiveInfo, start, mid, buildNodes, nodeCount);
+        });
+        node->right = recursiveBuild(primitiveInfo, mid, end, buildNodes, nodeCount);
+        group.wait();
+    }
+    else {
+        node->left = recursiveBuild(primitiveInfo, start, mid, buildNodes, nodeCount);
+        node->right = recursiveBuild(primitiveInfo, mid, end, buildNodes, nodeCount);
+    }
+
+    node->bounds = Union(node->left->bounds, node->right->bounds);
     return node;
 }
 
-Intersection BVHAccel::Intersect(const Ray& ray) const
+int BVHAccel::flattenBVHTree(BVHBuildNode* node, int* offset)
 {
-    Intersection isect;
-    if (!root)
-        return isect;
-    isect = BVHAccel::getIntersection(root, ray);
-    return isect;
+    LinearBVHNode* linearNode = &nodes[*offset];
+    linearNode->bounds = node->bounds;
+    int myOffset = (*offset)++;
+    if (node->left == nullptr && node->right == nullptr) {
+        linearNode->primitivesOffset = node->firstPrimOffset;
+        linearNode->nPrimitives = node->nPrimitives;
+    }
+    else {
+        // the first child is emitted right after its parent
+        linearNode->axis = node->splitAxis;
+        linearNode->nPrimitives = 0;
+        flattenBVHTree(node->left, offset);
+        linearNode->secondChildOffset = flattenBVHTree(node->right, offset);
+    }
+    return myOffset;
 }
 
-Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
+int BVHAccel::collapseBVH4(int nodeIndex)
 {
-    // TODO Traverse the BVH to find intersection
-    std::array<int, 3> dirisNeg = {int(ray.direction.x >0),int(ray.direction.y>0),int(ray.direction.z>0)};
-    Vector3f invDir(1.0f/ray.direction.x,1.0f/ray.direction.y,1.0f/ray.direction.z);
-    if (node == nullptr){
-        return Intersection();
+    // open up the largest interior node among the children until there are
+    // four of them (or only leaves are left)
+    int children[4];
+    int numChildren = 0;
+    if (nodes[nodeIndex].nPrimitives > 0) {
+        children[numChildren++] = nodeIndex;
     }
-    if (node->bounds.IntersectP(ray, invDir, dirisNeg) == false){
-        return Intersection();
+    else {
+        children[numChildren++] = nodeIndex + 1;
+        children[numChildren++] = nodes[nodeIndex].secondChildOffset;
     }
-    //check if the node is leaf
-    if (node->left == nullptr && node->right == nullptr){
-        return node->object->getIntersection(ray);
+    while (numChildren < 4) {
+        int best = -1;
+        float bestArea = -1;
+        for (int i = 0; i < numChildren; ++i) {
+            const LinearBVHNode& c = nodes[children[i]];
+            if (c.nPrimitives == 0 && c.bounds.SurfaceArea() > bestArea) {
+                best = i;
+                bestArea = c.bounds.SurfaceArea();
+            }
+        }
+        if (best < 0)
+            break;
+        int opened = children[best];
+        children[best] = opened + 1;
+        children[numChildren++] = nodes[opened].secondChildOffset;
+    }
+
+    int wideIndex = (int)wideNodes.size();
+    wideNodes.emplace_back();
+    for (int i = 0; i < 4; ++i) {
+        BVH4Node& wide = wideNodes[wideIndex];
+        if (i >= numChildren) {
+            // a box at +infinity: the ray either enters it at +infinity or
+            // leaves it at -infinity, so it never passes the slab test
+            wide.minX[i] = wide.minY[i] = wide.minZ[i] = INFINITY;
+            wide.maxX[i] = wide.maxY[i] = wide.maxZ[i] = INFINITY;
+            wide.child[i] = 0;
+            wide.count[i] = 0;
+            continue;
+        }
+        const LinearBVHNode& c = nodes[children[i]];
+        wide.minX[i] = c.bounds.pMin.x;
+        wide.minY[i] = c.bounds.pMin.y;
+        wide.minZ[i] = c.bounds.pMin.z;
+        wide.maxX[i] = c.bounds.pMax.x;
+        wide.maxY[i] = c.bounds.pMax.y;
+        wide.maxZ[i] = c.bounds.pMax.z;
+        if (c.nPrimitives > 0) {
+            // packets are laid out in primitive order, four per packet
+            wide.child[i] = mesh ? packetOffsets[c.primitivesOffset]
+                                 : c.primitivesOffset;
+            wide.count[i] = c.nPrimitives;
+        }
+        else {
+            // wideNodes may grow while recursing, do not keep the reference
+            int grandChild = collapseBVH4(children[i]);
+            wideNodes[wideIndex].child[i] = grandChild;
+            wideNodes[wideIndex].count[i] = 0;
+        }
+    }
+    return wideIndex;
+}
+
+void BVHAccel::buildTrianglePackets()
+{
+    // every leaf gets its own run of packets, so leaf primitives never share
+    // a packet with another leaf
+    trianglePackets.clear();
+    packetOffsets.assign(primitiveNumbers.size(), 0);
+    for (const LinearBVHNode& leaf : nodes) {
+        if (leaf.nPrimitives == 0)
+            continue;
+        packetOffsets[leaf.primitivesOffset] = (int)trianglePackets.size();
+        for (int first = 0; first < leaf.nPrimitives; first += 4) {
+            TrianglePacket packet = {};
+            for (int lane = 0; lane < 4; ++lane) {
+                int prim = leaf.primitivesOffset + first + lane;
+                if (first + lane >= leaf.nPrimitives) {
+                    // zero edges give det == 0, which the kernel rejects
+                    packet.prim[lane] = -1;
+                    continue;
+                }
+                uint32_t tri = primitiveNumbers[prim];
+                const Vector3f& v0 = mesh->vertex(tri, 0);
+                const Vector3f e1 = mesh->vertex(tri, 1) - v0;
+                const Vector3f e2 = mesh->vertex(tri, 2) - v0;
+                const Vector3f n = mesh->normal(tri);
+                for (int k = 0; k < 3; ++k) {
+                    packet.v0[k][lane] = v0[k];
+                    packet.e1[k][lane] = e1[k];
+                    packet.e2[k][lane] = e2[k];
+                    packet.n[k][lane] = n[k];
+                }
+                packet.prim[lane] = prim;
+            }
+            trianglePackets.push_back(packet);
+        }
     }
-    //not in leaf, check further
-    Intersection inter_left = getIntersection(node->left, ray);
-    Intersection inter_right = getIntersection(node->right,ray);
-    return inter_left.distance < inter_right.distance ? inter_left : inter_right;
 }
 
+// 4-wide Moller Trumbore with back faces culled. Returns the
+// mask of the lanes hit with 0 < t < tMax, their ray parameters through t and
+// their barycentrics through u and v.
+static int intersectPacket(const TrianglePacket& tri, const Ray& ray, float tMax,
+                           float4& t, float4& u, float4& v)
+{
+    const float4 dx(ray.direction.x), dy(ray.direction.y), dz(ray.direction.z);
+    const float4 zero(0.0f), one(1.0f), eps(EPSILON);
+    float4 e1x = float4::load(tri.e1[0]), e1y = float4::load(tri.e1[1]),
+           e1z = float4::load(tri.e1[2]);
+    float4 e2x = float4::load(tri.e2[0]), e2y = float4::load(tri.e2[1]),
+           e2z = float4::load(tri.e2[2]);
+    // back faces are culled
+    float4 facing = dx * float4::load(tri.n[0]) + dy * float4::load(tri.n[1]) +
+                    dz * float4::load(tri.n[2]);
+    float4 px = dy * e2z - dz * e2y;
+    float4 py = dz * e2x - dx * e2z;
+    float4 pz = dx * e2y - dy * e2x;
+    float4 det = e1x * px + e1y * py + e1z * pz;
+    float4 detInv = one / det;
+    float4 tx = float4(ray.origin.x) - float4::load(tri.v0[0]);
+    float4 ty = float4(ray.origin.y) - float4::load(tri.v0[1]);
+    float4 tz = float4(ray.origin.z) - float4::load(tri.v0[2]);
+    u = (tx * px + ty * py + tz * pz) * detInv;
+    float4 qx = ty * e1z - tz * e1y;
+    float4 qy = tz * e1x - tx * e1z;
+    float4 qz = tx * e1y - ty * e1x;
+    v = (dx * qx + dy * qy + dz * qz) * detInv;
+    t = (e2x * qx + e2y * qy + e2z * qz) * detInv;
+    float4 hit = (facing <= zero) & (abs(det) >= eps) & (u >= zero) &
+                 (u <= one) & (v >= zero) & (u + v <= one) & (t > zero) &
+                 (t < float4(tMax));
+    return movemask(hit);
+}
 
-void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf){
-    if(node->left == nullptr || node->right == nullptr){
-        node->object->Sample(pos, pdf);
-        pdf *= node->area;
+void BVHAccel::intersectLeaf(const Ray& ray, int first, int count,
+                             Intersection& isect) const
+{
+    if (!mesh) {
+        for (int i = 0; i < count; ++i) {
+            Intersection hit = primitives[first + i]->getIntersection(ray);
+            if (hit.happened && hit.distance < isect.distance)
+                isect = hit;
+        }
         return;
     }
-    if(p < node->left->area) getSample(node->left, p, pos, pdf);
-    else getSample(node->right, p - node->left->area, pos, pdf);
+
+    for (int p = first; p < first + (count + 3) / 4; ++p) {
+        const TrianglePacket& tri = trianglePackets[p];
+        float4 t, u, v;
+        int mask = intersectPacket(tri, ray, isect.distance, t, u, v);
+        if (!mask)
+            continue;
+        alignas(16) float ts[4], us[4], vs[4];
+        t.store(ts);
+        int best = -1;
+        for (int lane = 0; lane < 4; ++lane)
+            if ((mask & (1 << lane)) && (best < 0 || ts[lane] < ts[best]))
+                best = lane;
+        // candidates only keep t, the barycentrics and the primitive, the
+        // rest of the record is filled in once for the final hit
+        u.store(us);
+        v.store(vs);
+        isect.happened = true;
+        isect.distance = ts[best];
+        isect.u = us[best];
+        isect.v = vs[best];
+        isect.primId = tri.prim[best];
+    }
+}
+
+void BVHAccel::finishHit(Intersection& isect) const
+{
+    uint32_t tri = primitiveNumbers[isect.primId];
+    const Vector3f& v0 = mesh->vertex(tri, 0);
+    isect.coords = v0 + isect.u * (mesh->vertex(tri, 1) - v0) +
+                   isect.v * (mesh->vertex(tri, 2) - v0);
+    isect.normal = mesh->normal(tri);
+    isect.primId = (int)tri;
+}
+
+bool BVHAccel::occludedLeaf(const Ray& ray, int first, int count, float tMax) const
+{
+    if (!mesh) {
+        for (int i = 0; i < count; ++i)
+            if (primitives[first + i]->hasIntersection(ray, tMax))
+                return true;
+        return false;
+    }
+    for (int p = first; p < first + (count + 3) / 4; ++p) {
+        float4 t, u, v;
+        if (intersectPacket(trianglePackets[p], ray, tMax, t, u, v))
+            return true;
+    }
+    return false;
+}
+
+Intersection BVHAccel::Intersect(const Ray& ray) const
+{
+    Intersection isect;
+    if (wideNodes.empty())
+        return isect;
+
+    const float4 ox(ray.origin.x), oy(ray.origin.y), oz(ray.origin.z);
+    const float4 ix(ray.direction_inv.x), iy(ray.direction_inv.y),
+        iz(ray.direction_inv.z);
+    const float4 zero(0.0f);
+
+    // entries still to be visited together with the distance at which the
+    // ray enters their box
+    struct StackEntry {
+        int child, count;
+        float tEnter;
+    };
+    StackEntry toVisit[kTraversalStackSize];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = {0, 0, 0.0f};
+    int nodesVisited = 0, triangleTests = 0;
+    while (toVisitOffset > 0) {
+        StackEntry entry = toVisit[--toVisitOffset];
+        // skip entries that start beyond the closest hit found so far
+        if (entry.tEnter >= isect.distance)
+            continue;
+        if (entry.count > 0) {
+            if (mesh)
+                triangleTests += entry.count;
+            intersectLeaf(ray, entry.child, entry.count, isect);
+            continue;
+        }
+
+        // slab test against all four child boxes at once
+        const BVH4Node& node = wideNodes[entry.child];
+        nodesVisited++;
+        float4 t1x = (float4::load(node.minX) - ox) * ix;
+        float4 t2x = (float4::load(node.maxX) - ox) * ix;
+        float4 t1y = (float4::load(node.minY) - oy) * iy;
+        float4 t2y = (float4::load(node.maxY) - oy) * iy;
+        float4 t1z = (float4::load(node.minZ) - oz) * iz;
+        float4 t2z = (float4::load(node.maxZ) - oz) * iz;
+        float4 tEnter = max(max(min(t1x, t2x), min(t1y, t2y)), min(t1z, t2z));
+        float4 tExit = min(min(max(t1x, t2x), max(t1y, t2y)), max(t1z, t2z));
+        int mask = movemask((tEnter <= tExit) & (tExit > zero) &
+                            (tEnter < float4(isect.distance)));
+        if (!mask)
+            continue;
+
+        // push the hit children far to near so the nearest is popped first
+        alignas(16) float ts[4];
+        tEnter.store(ts);
+        int order[4], numHit = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            if (!(mask & (1 << lane)))
+                continue;
+            int k = numHit++;
+            while (k > 0 && ts[order[k - 1]] < ts[lane]) {
+                order[k] = order[k - 1];
+                --k;
+            }
+            order[k] = lane;
+        }
+        assert(toVisitOffset + 4 <= kTraversalStackSize);
+        for (int k = 0; k < numHit; ++k) {
+            int lane = order[k];
+            toVisit[toVisitOffset++] = {node.child[lane], node.count[lane],
+                                        std::max(ts[lane], 0.0f)};
+        }
+    }
+    stats::add(stats::BVHNodesVisited, nodesVisited);
+    stats::add(stats::TriangleTests, triangleTests);
+    if (isect.happened && mesh)
+        finishHit(isect);
+    return isect;
 }
 
-void BVHAccel::Sample(Intersection &pos, float &pdf){
-    float p = std::sqrt(get_random_float()) * root->area;
-    getSample(root, p, pos, pdf);
-    pdf /= root->area;
-}
\ No newline at end of file
+bool BVHAccel::IntersectP(const Ray& ray, float tMax) const
+{
+    if (wideNodes.empty())
+        return false;
+
+    const float4 ox(ray.origin.x), oy(ray.origin.y), oz(ray.origin.z);
+    const float4 ix(ray.direction_inv.x), iy(ray.direction_inv.y),
+        iz(ray.direction_inv.z);
+    const float4 zero(0.0f), maxT(tMax);
+
+    // any hit ends the query, so children are visited in no particular order
+    struct StackEntry {
+        int child, count;
+    };
+    StackEntry toVisit[kTraversalStackSize];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = {0, 0};
+    int nodesVisited = 0, triangleTests = 0;
+    bool occluded = false;
+    while (toVisitOffset > 0 && !occluded) {
+        StackEntry entry = toVisit[--toVisitOffset];
+        if (entry.count > 0) {
+            if (mesh)
+                triangleTests += entry.count;
+            occluded = occludedLeaf(ray, entry.child, entry.count, tMax);
+            continue;
+        }
+
+        const BVH4Node& node = wideNodes[entry.child];
+        nodesVisited++;
+        float4 t1x = (float4::load(node.minX) - ox) * ix;
+        float4 t2x = (float4::load(node.maxX) - ox) * ix;
+        float4 t1y = (float4::load(node.minY) - oy) * iy;
+        float4 t2y = (float4::load(node.maxY) - oy) * iy;
+        float4 t1z = (float4::load(node.minZ) - oz) * iz;
+        float4 t2z = (float4::load(node.maxZ) - oz) * iz;
+        float4 tEnter = max(max(min(t1x, t2x), min(t1y, t2y)), min(t1z, t2z));
+        float4 tExit = min(min(max(t1x, t2x), max(t1y, t2y)), max(t1z, t2z));
+        int mask = movemask((tEnter <= tExit) & (tExit > zero) & (tEnter < maxT));
+        assert(toVisitOffset + 4 <= kTraversalStackSize);
+        for (int lane = 0; lane < 4; ++lane)
+            if (mask & (1 << lane))
+                toVisit[toVisitOffset++] = {node.child[lane], node.count[lane]};
+    }
+    stats::add(stats::BVHNodesVisited, nodesVisited);
+    stats::add(stats::TriangleTests, triangleTests);
+    return occluded;
+}
@@ -14,11 +14,54 @@
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "Simd.hpp"
+#include "TriangleMesh.hpp"
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
 struct BVHPrimitiveInfo;
 
+// Node of the flattened BVH, stored in depth-first order so that the first
+// child of an interior node always directly follows it in the array. Two
+// nodes share one 64 byte cache line.
+struct alignas(32) LinearBVHNode {
+    Bounds3 bounds;
+    union {
+        int primitivesOffset;   // leaf
+        int secondChildOffset;  // interior
+    };
+    uint16_t nPrimitives;  // 0 -> interior node
+    uint8_t axis;          // interior node: xyz
+    uint8_t pad[1];        // ensure 32 byte total size
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must be 32 bytes");
+
+// Node of the 4-wide BVH that traversal actually walks. It is collapsed from
+// the binary tree and keeps the boxes of all four children in SoA form so a
+// single SIMD slab test handles them at once. Unused child slots hold a box
+// that no ray can hit.
+struct alignas(64) BVH4Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    // interior child: index of its BVH4Node
+    // leaf child: first primitive, or first TrianglePacket of a mesh BVH
+    int child[4];
+    // number of primitives of a leaf child, 0 for an interior child
+    int count[4];
+};
+static_assert(sizeof(BVH4Node) == 128, "BVH4Node must span two cache lines");
+
+// Up to four triangles of one leaf, pre-transformed into the SoA layout used
+// by the 4-wide Moller Trumbore kernel. Unused lanes are degenerate. prim is
+// the leaf order index of the triangle.
+struct alignas(16) TrianglePacket {
+    float v0[3][4];
+    float e1[3][4];
+    float e2[3][4];
+    float n[3][4];
+    int prim[4];
+};
+
 // BVHAccel Declarations
 inline int leafNodes, totalLeafNodes, totalPrimitives, interiorNodes;
 class BVHAccel {
@@ -29,32 +72,87 @@ public:
 
     // BVHAccel Public Methods
     BVHAccel(std::vector<Object*> p, int maxPrimsInNode = 1, SplitMethod splitMethod = SplitMethod::NAIVE);
+    // over the triangles of an indexed mesh; leaves test packets of them
+    // directly, without going through Object
+    BVHAccel(std::shared_ptr<const TriangleMesh> mesh, int maxPrimsInNode = 4,
+             SplitMethod splitMethod = SplitMethod::NAIVE);
+    // over a mesh with a tree built earlier (see MeshCache.hpp): the
+    // flattened nodes and the mesh triangle of every leaf order index
+    BVHAccel(std::shared_ptr<const TriangleMesh> mesh, std::vector<LinearBVHNode> nodes,
+             std::vector<int> primitiveNumbers, int maxPrimsInNode,
+             SplitMethod splitMethod);
     Bounds3 WorldBound() const;
     ~BVHAccel();
+    BVHAccel(const BVHAccel&) = delete;
+    BVHAccel& operator=(const BVHAccel&) = delete;
 
     Intersection Intersect(const Ray &ray) const;
-    Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
-    bool IntersectP(const Ray &ray) const;
-    BVHBuildNode* root;
+    // true if anything is hit with 0 < t < tMax, returns at the first hit
+    bool IntersectP(const Ray &ray, float tMax) const;
+
+    // For animated scenes: call after the primitives moved or deformed.
+    // refit() recomputes all bounds bottom-up and keeps the tree topology.
+    // update() refits and then rebuilds from scratch if the SAH cost of the
+    // refit tree exceeds maxCostRatio times the cost it had when built.
+    // Returns true if it rebuilt.
+    static constexpr float DefaultMaxCostRatio = 1.5f;
+    void refit();
+    bool update(float maxCostRatio = DefaultMaxCostRatio);
+    // expected cost of a ray through the binary tree in units of primitive
+    // tests, with the same cost model as the SAH build
+    float sahCost() const;
 
     // BVHAccel Private Methods
-    BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
+    // builds the tree over the current primitive bounds, replacing any old one
+    void build();
+    // bounds of the primitive at leaf order index i
+    Bounds3 primitiveBounds(int i) const;
+    BVHBuildNode* recursiveBuild(std::vector<BVHPrimitiveInfo>& primitiveInfo,
+                                 int start, int end,
+                                 std::vector<BVHBuildNode>& buildNodes,
+                                 std::atomic<int>& nodeCount);
+    BVHBuildNode* createLeaf(BVHBuildNode* node, int start, int end,
+                             const Bounds3& bounds);
+    int splitSAH(std::vector<BVHPrimitiveInfo>& primitiveInfo, int start,
+                 int end, const Bounds3& bounds,
+                 const Bounds3& centroidBounds, int dim) const;
+    int flattenBVHTree(BVHBuildNode* node, int* offset);
+    int collapseBVH4(int nodeIndex);
+    void buildTrianglePackets();
+    void intersectLeaf(const Ray& ray, int first, int count,
+                       Intersection& isect) const;
+    // fills in the position and normal of the closest packet hit from t, u,
+    // v and primId, and maps primId back to the triangle index in the mesh
+    void finishHit(Intersection& isect) const;
+    bool occludedLeaf(const Ray& ray, int first, int count, float tMax) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
+    // primitives in the depth-first order of the leaves referencing them,
+    // empty for a mesh BVH
     std::vector<Object*> primitives;
-
-    void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
-    void Sample(Intersection &pos, float &pdf);
+    // the triangles of a mesh BVH, null otherwise
+    std::shared_ptr<const TriangleMesh> mesh;
+    // original index of every primitive in leaf order
+    std::vector<int> primitiveNumbers;
+    // the flattened tree; nodes[0] is the root
+    std::vector<LinearBVHNode> nodes;
+    // the 4-wide tree used for intersection; wideNodes[0] is the root
+    std::vector<BVH4Node> wideNodes;
+    // SoA triangle data of every leaf of a mesh BVH
+    std::vector<TrianglePacket> trianglePackets;
+    // first packet of the leaf starting at each primitive offset
+    std::vector<int> packetOffsets;
+    int totalNodes = 0;
+    // sahCost() right after the last build
+    float builtCost = 0;
 };
 
 struct BVHBuildNode {
     Bounds3 bounds;
     BVHBuildNode *left;
     BVHBuildNode *right;
-    Object* object;
-    float area;
 
 public:
     int splitAxis=0, firstPrimOffset=0, nPrimitives=0;
@@ -62,7 +160,6 @@ public:
     BVHBuildNode(){
         bounds = Bounds3();
         left = nullptr;right = nullptr;
-        object = nullptr;
     }
 };
 
@@ -0,0 +1,284 @@
+//
+// BVH benchmark: build time per SplitMethod, refit time, and single-thread
+// closest-hit / occlusion throughput for coherent (pinhole camera) and
+// incoherent (random) rays over the bundled models, and over a grid of
+// instances of one model.
+// Results are written as JSON.
+//
+// Run from the build directory like the renderer:
+//   ./Benchmark [--output PATH] [--rays N] [--builds N]
+//
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "BVH.hpp"
+#include "Instance.hpp"
+#include "ObjParser.hpp"
+#include "Random.hpp"
+#include "Stats.hpp"
+#include "Triangle.hpp"
+
+const float EPSILON = 0.00001;
+
+namespace {
+
+struct Model
+{
+    std::string name;
+    std::vector<std::string> files;
+};
+
+// A query ray with the distance up to which occlusion is tested.
+struct QueryRay
+{
+    Ray ray;
+    float tMax;
+};
+
+double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Loads every face of every mesh in the files into one indexed mesh.
+bool loadTriangles(const Model& model, TriangleMesh& mesh)
+{
+    for (const std::string& file : model.files) {
+        if (!parseOBJ(file, mesh)) {
+            std::cerr << "Skipping " << model.name << ", cannot load " << file << "\n";
+            return false;
+        }
+    }
+    return mesh.size() > 0;
+}
+
+// Primary rays of a square pinhole camera that looks at the model from -z,
+// neighbouring rays take nearly the same path through the tree.
+std::vector<QueryRay> coherentRays(const Bounds3& bounds, int count)
+{
+    int side = std::max(1, (int)std::sqrt((double)count));
+    Vector3f center = bounds.Centroid();
+    float radius = bounds.Diagonal().norm() * 0.5f;
+    Vector3f eye = center - Vector3f(0, 0, 3 * radius);
+    // a 40 degree field of view frames the bounding sphere
+    float scale = std::tan(20.0f * M_PI / 180.0f);
+    std::vector<QueryRay> rays;
+    rays.reserve(side * side);
+    for (int j = 0; j < side; ++j)
+        for (int i = 0; i < side; ++i) {
+            float x = (2 * (i + 0.5f) / side - 1) * scale;
+            float y = (1 - 2 * (j + 0.5f) / side) * scale;
+            rays.push_back({Ray(eye, normalize(Vector3f(x, y, 1))), kInfinity});
+        }
+    return rays;
+}
+
+// Rays from random points on the bounding sphere towards random points inside
+// the box, occlusion is tested up to the target point.
+std::vector<QueryRay> incoherentRays(const Bounds3& bounds, int count)
+{
+    RNG rng(1, 0, 0);
+    Vector3f center = bounds.Centroid();
+    float radius = bounds.Diagonal().norm() * 0.5f;
+    std::vector<QueryRay> rays;
+    rays.reserve(count);
+    for (int k = 0; k < count; ++k) {
+        float z = 1 - 2 * rng.uniform(), phi = 2 * M_PI * rng.uniform();
+        float r = std::sqrt(std::max(0.0f, 1 - z * z));
+        Vector3f origin = center + radius * Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+        Vector3f target(bounds.pMin.x + rng.uniform() * (bounds.pMax.x - bounds.pMin.x),
+                        bounds.pMin.y + rng.uniform() * (bounds.pMax.y - bounds.pMin.y),
+                        bounds.pMin.z + rng.uniform() * (bounds.pMax.z - bounds.pMin.z));
+        Vector3f d = target - origin;
+        float dist = d.norm();
+        rays.push_back({Ray(origin, d / dist), dist});
+    }
+    return rays;
+}
+
+// Traces all rays repeatedly for at least minSeconds and appends one JSON
+// result object to out.
+void measure(const BVHAccel& bvh, const std::vector<QueryRay>& rays, bool occlusion,
+             const char* split, const char* kind, std::ostringstream& out)
+{
+    const double minSeconds = 0.25;
+    uint64_t nodes0 = stats::total(stats::BVHNodesVisited);
+    uint64_t tests0 = stats::total(stats::TriangleTests);
+    uint64_t traced = 0, hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        hits = 0;
+        for (const QueryRay& q : rays) {
+            if (occlusion)
+                hits += bvh.IntersectP(q.ray, q.tMax);
+            else
+                hits += bvh.Intersect(q.ray).happened;
+        }
+        traced += rays.size();
+        elapsed = seconds(start);
+    } while (elapsed < minSeconds);
+    double nodes = stats::total(stats::BVHNodesVisited) - nodes0;
+    double tests = stats::total(stats::TriangleTests) - tests0;
+
+    char line[320];
+    snprintf(line, sizeof(line),
+             "        {\"split\": \"%s\", \"rays\": \"%s\", \"query\": \"%s\", "
+             "\"mrays_per_second\": %.3f, \"hit_fraction\": %.4f, "
+             "\"nodes_per_ray\": %.2f, \"triangle_tests_per_ray\": %.2f}",
+             split, kind, occlusion ? "occlusion" : "closest", traced / elapsed * 1e-6,
+             hits / (double)rays.size(), nodes / traced, tests / traced);
+    out << line;
+}
+
+// A wall of randomly rotated copies of the bunny facing the coherent rays. All
+// copies share one mesh BVH, only the top level BVH over the instances is
+// built for the scene.
+void measureInstances(int numRays, std::ostringstream& out)
+{
+    const std::string file = "../models/bunny/bunny.obj";
+    if (!std::ifstream(file)) {
+        std::cerr << "Skipping instances, cannot load " << file << "\n";
+        return;
+    }
+    Material material;
+    auto bunny = std::make_shared<MeshTriangle>(file, &material, BVHAccel::SplitMethod::SAH);
+    const int side = 16;
+    float spacing = bunny->getBounds().Diagonal().norm();
+    RNG rng(2, 0, 0);
+    std::vector<std::unique_ptr<Instance>> instances;
+    std::vector<Object*> ptrs;
+    for (int i = 0; i < side; ++i)
+        for (int j = 0; j < side; ++j) {
+            Transform toWorld = Transform::translate(Vector3f(i * spacing, j * spacing, 0)) *
+                                Transform::rotate(360 * rng.uniform(), Vector3f(0, 1, 0));
+            instances.push_back(std::make_unique<Instance>(bunny, toWorld));
+            ptrs.push_back(instances.back().get());
+        }
+    auto start = std::chrono::steady_clock::now();
+    BVHAccel topLevel(ptrs, 1, BVHAccel::SplitMethod::SAH);
+    double buildSeconds = seconds(start);
+
+    char line[160];
+    snprintf(line, sizeof(line),
+             ",\n  \"instanced\": {\"instances\": %d, \"triangles_per_instance\": %u, "
+             "\"top_level_build_ms\": %.3f,\n    \"traversal\": [\n",
+             side * side, bunny->numTriangles, buildSeconds * 1e3);
+    out << line;
+    Bounds3 bounds = topLevel.WorldBound();
+    const std::pair<std::vector<QueryRay>, const char*> raySets[] = {
+        {coherentRays(bounds, numRays), "coherent"},
+        {incoherentRays(bounds, numRays), "incoherent"}};
+    bool firstResult = true;
+    for (const auto& set : raySets)
+        for (bool occlusion : {false, true}) {
+            out << (firstResult ? "" : ",\n");
+            firstResult = false;
+            measure(topLevel, set.first, occlusion, "SAH", set.second, out);
+        }
+    out << "\n    ]}";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string outputPath = "benchmark.json";
+    int numRays = 1 << 16;
+    int numBuilds = 5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--output" && hasValue) outputPath = argv[++i];
+        else if (arg == "--rays" && hasValue) numRays = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--builds" && hasValue) numBuilds = std::max(1, std::atoi(argv[++i]));
+        else {
+            std::cerr << "Unknown argument " << arg << "\n";
+            return 1;
+        }
+    }
+
+    const std::string a3 = "../../Assignment3/models/";
+    const std::vector<Model> models = {
+        {"bunny", {"../models/bunny/bunny.obj"}},
+        {"cornellbox",
+         {"../models/cornellbox/floor.obj", "../models/cornellbox/shortbox.obj",
+          "../models/cornellbox/tallbox.obj", "../models/cornellbox/left.obj",
+          "../models/cornellbox/right.obj", "../models/cornellbox/light.obj"}},
+        {"spot", {a3 + "spot/spot_triangulated.obj"}},
+        {"rock", {a3 + "rock/rock.obj"}},
+        {"crate", {a3 + "Crate/Crate1.obj"}},
+    };
+    const std::pair<BVHAccel::SplitMethod, const char*> splits[] = {
+        {BVHAccel::SplitMethod::NAIVE, "NAIVE"}, {BVHAccel::SplitMethod::SAH, "SAH"}};
+
+    std::ostringstream out;
+    out << "{\n  \"rays_per_set\": " << numRays << ",\n  \"models\": [";
+    bool firstModel = true;
+    for (const Model& model : models) {
+        auto mesh = std::make_shared<TriangleMesh>();
+        if (!loadTriangles(model, *mesh))
+            continue;
+
+        out << (firstModel ? "\n" : ",\n") << "    {\"name\": \"" << model.name
+            << "\", \"triangles\": " << mesh->size() << ",\n      \"build_ms\": {";
+        firstModel = false;
+        std::vector<std::unique_ptr<BVHAccel>> bvhs;
+        for (size_t s = 0; s < 2; ++s) {
+            // best of several builds, the first one also warms the thread pool
+            double best = 1e30;
+            for (int b = 0; b < numBuilds; ++b) {
+                auto start = std::chrono::steady_clock::now();
+                auto bvh = std::make_unique<BVHAccel>(mesh, 4, splits[s].first);
+                best = std::min(best, seconds(start));
+                if (b + 1 == numBuilds)
+                    bvhs.push_back(std::move(bvh));
+            }
+            char line[64];
+            snprintf(line, sizeof(line), "%s\"%s\": %.3f", s ? ", " : "", splits[s].second,
+                     best * 1e3);
+            out << line;
+        }
+        // refitting the SAH tree in place, as an animation frame would
+        double bestRefit = 1e30;
+        for (int b = 0; b < numBuilds; ++b) {
+            auto start = std::chrono::steady_clock::now();
+            bvhs[1]->refit();
+            bestRefit = std::min(bestRefit, seconds(start));
+        }
+        char line[64];
+        snprintf(line, sizeof(line), ", \"SAH refit\": %.3f", bestRefit * 1e3);
+        out << line << "},\n      \"traversal\": [\n";
+
+        Bounds3 bounds = bvhs[0]->WorldBound();
+        const std::pair<std::vector<QueryRay>, const char*> raySets[] = {
+            {coherentRays(bounds, numRays), "coherent"},
+            {incoherentRays(bounds, numRays), "incoherent"}};
+        bool firstResult = true;
+        for (size_t s = 0; s < 2; ++s)
+            for (const auto& set : raySets)
+                for (bool occlusion : {false, true}) {
+                    out << (firstResult ? "" : ",\n");
+                    firstResult = false;
+                    measure(*bvhs[s], set.first, occlusion, splits[s].second, set.second,
+                            out);
+                }
+        out << "\n      ]}";
+    }
+    out << "\n  ]";
+    measureInstances(numRays, out);
+    out << "\n}\n";
+
+    std::ofstream file(outputPath);
+    file << out.str();
+    if (!file) {
+        std::cerr << "Cannot write " << outputPath << "\n";
+        return 1;
+    }
+    std::cout << "Benchmark results written to " << outputPath << "\n";
+    return 0;
+}
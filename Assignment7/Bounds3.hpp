@@ -15,8 +15,8 @@ class Bounds3
     Vector3f pMin, pMax; // two points to specify the bounding box
     Bounds3()
     {
-        double minNum = std::numeric_limits<double>::lowest();
-        double maxNum = std::numeric_limits<double>::max();
+        float minNum = std::numeric_limits<float>::lowest();
+        float maxNum = std::numeric_limits<float>::max();
         pMax = Vector3f(minNum, minNum, minNum);
         pMin = Vector3f(maxNum, maxNum, maxNum);
     }
@@ -39,13 +39,13 @@ class Bounds3
             return 2;
     }
 
-    double SurfaceArea() const
+    float SurfaceArea() const
     {
         Vector3f d = Diagonal();
         return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
     }
 
-    Vector3f Centroid() { return 0.5 * pMin + 0.5 * pMax; }
+    Vector3f Centroid() const { return 0.5 * pMin + 0.5 * pMax; }
     Bounds3 Intersect(const Bounds3& b)
     {
         return Bounds3(Vector3f(fmax(pMin.x, b.pMin.x), fmax(pMin.y, b.pMin.y),
@@ -96,20 +96,20 @@ inline bool Bounds3::IntersectP(const Ray& ray, const Vector3f& invDir,
     // invDir: ray direction(x,y,z), invDir=(1.0/x,1.0/y,1.0/z), use this because Multiply is faster that Division
     // dirIsNeg: ray direction(x,y,z), dirIsNeg=[int(x>0),int(y>0),int(z>0)], use this to simplify your logic
     // TODO test if ray bound intersects
-    double t1 = 0;
-    double t2 = 0;
+    float t1 = 0;
+    float t2 = 0;
     t1 = (pMin.x - ray.origin.x) * invDir.x;
     t2 = (pMax.x - ray.origin.x) * invDir.x;
-    double txmin = (dirIsNeg[0]>0)?t1:t2;
-    double txmax = (dirIsNeg[0]>0)?t2:t1;
+    float txmin = (dirIsNeg[0]>0)?t1:t2;
+    float txmax = (dirIsNeg[0]>0)?t2:t1;
     t1 = (pMin.y - ray.origin.y) * invDir.y;
     t2 = (pMax.y - ray.origin.y) * invDir.y;
-    double tymin = (dirIsNeg[1]>0)?t1:t2;
-    double tymax = (dirIsNeg[1]>0)?t2:t1;
+    float tymin = (dirIsNeg[1]>0)?t1:t2;
+    float tymax = (dirIsNeg[1]>0)?t2:t1;
     t1 = (pMin.z - ray.origin.z) * invDir.z;
     t2 = (pMax.z - ray.origin.z) * invDir.z;
-    double tzmin = (dirIsNeg[2]>0)?t1:t2;
-    double tzmax = (dirIsNeg[2]>0)?t2:t1;
+    float tzmin = (dirIsNeg[2]>0)?t1:t2;
+    float tzmax = (dirIsNeg[2]>0)?t2:t1;
     
     if((std::max(std::max(txmin,tymin),tzmin) <= std::min(std::min(txmax,tymax),tzmax)) && 
        (std::min(std::min(txmax,tymax),tzmax)>0)){
@@ -0,0 +1,132 @@
+//
+// A placed copy of a shared mesh.
+//
+#pragma once
+
+#include <memory>
+#include "Transform.hpp"
+#include "Triangle.hpp"
+
+// An instance refers to a MeshTriangle and its BVH, which act as the bottom
+// level acceleration structure, and places it in the world with a transform.
+// The scene BVH over instances is the top level. Rays are taken into object
+// space for the mesh BVH and their direction is renormalized there, because
+// the triangle test rejects small determinants in absolute terms; ray
+// parameters are scaled by the length of the transformed direction.
+//
+// An instance only stores its transform and bounds, the geometry is shared
+// by all instances of the mesh. Emitting instances additionally keep an area
+// table in world space for light sampling.
+class Instance : public Object
+{
+public:
+    Instance(std::shared_ptr<MeshTriangle> mesh, const Transform& toWorld,
+             Material* mt = nullptr)
+        : mesh(std::move(mesh)), m(mt ? mt : this->mesh->m)
+    {
+        setTransform(toWorld);
+    }
+
+    // Places the instance anew. Also call it after the shared mesh was
+    // updated, the instance bounds and area depend on it.
+    void setTransform(const Transform& transform)
+    {
+        toWorld = transform;
+        toObject = transform.inverse();
+        bounding_box = toWorld.bounds(mesh->getBounds());
+        // a non-uniform scale changes the relative triangle areas, so the
+        // world space area is summed per triangle
+        const TriangleMesh& tris = *mesh->mesh;
+        std::vector<float> areas(m->hasEmission() ? tris.size() : 0);
+        area = 0;
+        for (uint32_t i = 0; i < tris.size(); ++i) {
+            Vector3f v0 = toWorld.point(tris.vertex(i, 0));
+            float a = crossProduct(toWorld.point(tris.vertex(i, 1)) - v0,
+                                   toWorld.point(tris.vertex(i, 2)) - v0).norm() * 0.5f;
+            if (!areas.empty())
+                areas[i] = a;
+            area += a;
+        }
+        areaTable = AliasTable(areas);
+    }
+
+    Intersection getIntersection(Ray ray) override
+    {
+        float scale;
+        Intersection intersec = mesh->bvh->Intersect(toObjectSpace(ray, scale));
+        if (intersec.happened) {
+            intersec.distance /= scale;
+            intersec.coords = toWorld.point(intersec.coords);
+            intersec.normal = normalize(toWorld.normal(intersec.normal));
+            intersec.obj = this;
+            intersec.m = m;
+            intersec.emit = m->getEmission();
+        }
+        return intersec;
+    }
+
+    bool hasIntersection(const Ray& ray, float tMax) override
+    {
+        float scale;
+        Ray local = toObjectSpace(ray, scale);
+        return mesh->bvh->IntersectP(local, tMax * scale);
+    }
+
+    // not used function here (only overide the base class)
+    Vector3f evalDiffuseColor(const Vector2f &) const override
+    {
+        return Vector3f();
+    }
+
+    Bounds3 getBounds() override
+    {
+        return bounding_box;
+    }
+
+    // uniform over the world space surface, only available for emitters
+    void Sample(Intersection &pos, float &pdf, const Vector2f &u) override
+    {
+        if (areaTable.empty()) {
+            pdf = 0;
+            return;
+        }
+        float remapped;
+        uint32_t k = areaTable.sample(u.x, &remapped);
+        const TriangleMesh& tris = *mesh->mesh;
+        pos.coords = toWorld.point(tris.samplePoint(k, Vector2f(remapped, u.y)));
+        pos.normal = normalize(toWorld.normal(tris.normal(k)));
+        pdf = 1.0f / area;
+        pos.emit = m->getEmission();
+    }
+
+    float getArea() override
+    {
+        return area;
+    }
+
+    bool hasEmit() override
+    {
+        return m->hasEmission();
+    }
+
+    Vector3f getEmission() override
+    {
+        return m->getEmission();
+    }
+
+    // ray in object space with a unit direction; a distance t along ray is
+    // t * scale along the returned ray
+    Ray toObjectSpace(const Ray& ray, float& scale) const
+    {
+        Vector3f d = toObject.vector(ray.direction);
+        scale = d.norm();
+        return Ray(toObject.point(ray.origin), d / scale);
+    }
+
+    std::shared_ptr<MeshTriangle> mesh;
+    Transform toWorld, toObject;
+    Bounds3 bounding_box;
+    AliasTable areaTable;
+    float area;
+    Material* m;
+};
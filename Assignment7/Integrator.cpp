@@ -0,0 +1,194 @@
+//
+// Wavefront path tracer, see Integrator.hpp.
+//
+#include "Integrator.hpp"
+#include "Stats.hpp"
+
+// power heuristic with beta = 2
+static float powerHeuristic(float pdf, float otherPdf)
+{
+    float a = pdf * pdf, b = otherPdf * otherPdf;
+    return a + b > 0 ? a / (a + b) : 0.0f;
+}
+
+// shadow rays stop this far before the sampled light point
+static const float ShadowEpsilon = 0.1f;
+
+void WavefrontIntegrator::PathStates::resize(size_t n)
+{
+    origin.resize(n);
+    direction.resize(n);
+    throughput.resize(n);
+    sample.resize(n);
+    depth.resize(n);
+    bsdfPdf.resize(n);
+    samplerState.resize(n);
+    hit.resize(n);
+    alive.resize(n);
+}
+
+void WavefrontIntegrator::ShadowRays::clear()
+{
+    origin.clear();
+    target.clear();
+    contribution.clear();
+    sample.clear();
+}
+
+void WavefrontIntegrator::Render(const std::vector<CameraSample>& cameraSamples,
+                                 std::vector<Vector3f>& radiance)
+{
+    radiance.assign(cameraSamples.size(), Vector3f(0));
+    paths.resize(cameraSamples.size());
+    for (size_t i = 0; i < cameraSamples.size(); ++i) {
+        const CameraSample& cs = cameraSamples[i];
+        paths.origin[i] = cs.ray.origin;
+        paths.direction[i] = cs.ray.direction;
+        paths.throughput[i] = Vector3f(1);
+        paths.sample[i] = (int)i;
+        paths.depth[i] = 0;
+        paths.bsdfPdf[i] = 0;
+        paths.samplerState[i] = {(uint32_t)cs.pixel, (uint32_t)cs.index, 0};
+        paths.alive[i] = 1;
+    }
+
+    stats::add(stats::Paths, paths.size());
+    stats::add(stats::CameraRays, paths.size());
+    while (paths.size() > 0) {
+        extend();
+        shade(radiance);
+        connect(radiance);
+        compact();
+        stats::add(stats::ExtensionRays, paths.size());
+    }
+}
+
+void WavefrontIntegrator::extend()
+{
+    for (size_t i = 0; i < paths.size(); ++i)
+        paths.hit[i] = scene.Intersect(Ray(paths.origin[i], paths.direction[i]));
+}
+
+void WavefrontIntegrator::shade(std::vector<Vector3f>& radiance)
+{
+    shadowRays.clear();
+    uint64_t vertices = 0, terminated = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const Intersection& inter = paths.hit[i];
+        if (!inter.happened) {
+            paths.alive[i] = 0;
+            continue;
+        }
+        //hit light source (here, the light source refers to the MeshTriangle with
+        //emitting material). Camera rays count it in full. For BSDF rays the
+        //light sample of the previous vertex covers the same light, so they
+        //count only with MIS and then share it with that sample.
+        if (inter.obj->hasEmit()) {
+            if (paths.depth[i] == 0) {
+                radiance[paths.sample[i]] += paths.throughput[i] * inter.m->getEmission();
+            }
+            else if (options.mis) {
+                float cos_light_source = dotProduct(-paths.direction[i], inter.normal);
+                if (cos_light_source > 0) {
+                    float pdf_light = scene.pdfLight(inter) * inter.distance *
+                                      inter.distance / cos_light_source;
+                    float weight = powerHeuristic(paths.bsdfPdf[i], pdf_light);
+                    radiance[paths.sample[i]] +=
+                        paths.throughput[i] * inter.m->getEmission() * weight;
+                }
+            }
+            paths.alive[i] = 0;
+            continue;
+        }
+        //hit diffuse material
+        vertices++;
+        Vector3f wo = normalize(-paths.direction[i]);
+        Material* m = inter.m;
+        Vector3f N = normalize(inter.normal);
+        Vector3f p = inter.coords;
+
+        //every bounce draws the same dimensions in the same order
+        SamplerState& ss = paths.samplerState[i];
+
+        //direct lighting: the shadow ray is traced in connect()
+        float pdf_light = 0;
+        Intersection light_inter;
+        scene.sampleLight(light_inter, pdf_light, sampler.get2D(ss));
+        if (pdf_light > 0) {
+            Vector3f x = light_inter.coords;
+            //ws is pointing from shading point to light source
+            Vector3f ws = normalize(x - p);
+            Vector3f N_light = light_inter.normal;
+            float cos_shading_point = std::max(0.0f, dotProduct(ws, N));
+            float cos_light_source = std::max(0.0f, dotProduct(-ws, N_light));
+            Vector3f L_dir = light_inter.emit * m->eval(ws, wo, N) * cos_shading_point *
+                             cos_light_source / (x - p).norm2() / pdf_light;
+            if (options.mis && cos_light_source > 0) {
+                //the same direction could also have been found by BSDF sampling
+                float pdf_light_w = pdf_light * (x - p).norm2() / cos_light_source;
+                L_dir = L_dir * powerHeuristic(pdf_light_w,
+                                               m->pdf(ws, wo, N, options.cosineSampling));
+            }
+            shadowRays.origin.push_back(p);
+            shadowRays.target.push_back(x);
+            shadowRays.contribution.push_back(paths.throughput[i] * L_dir);
+            shadowRays.sample.push_back(paths.sample[i]);
+        }
+
+        //test Russian Roulette, survivors continue with the indirect light
+        if (sampler.get1D(ss) < scene.RussianRoulette) {
+            Vector3f wi = m->sampleHemisphere(wo, N, sampler.get2D(ss),
+                                              options.cosineSampling);
+            float pdf = m->pdf(wi, wo, N, options.cosineSampling);
+            if (pdf <= 0) {
+                paths.alive[i] = 0;
+                continue;
+            }
+            paths.throughput[i] = paths.throughput[i] * m->eval(wi, wo, N) *
+                                  dotProduct(wi, N) / pdf / scene.RussianRoulette;
+            paths.bsdfPdf[i] = pdf;
+            paths.origin[i] = p;
+            paths.direction[i] = wi;
+            paths.depth[i]++;
+        }
+        else {
+            paths.alive[i] = 0;
+            terminated++;
+        }
+    }
+    stats::add(stats::PathVertices, vertices);
+    stats::add(stats::RussianRouletteTerminations, terminated);
+}
+
+void WavefrontIntegrator::connect(std::vector<Vector3f>& radiance)
+{
+    stats::add(stats::ShadowRays, shadowRays.size());
+    for (size_t i = 0; i < shadowRays.size(); ++i) {
+        Vector3f d = shadowRays.target[i] - shadowRays.origin[i];
+        float dist = d.norm();
+        //not blocked by objects, the light itself is hit at dist
+        if (!scene.IntersectP(Ray(shadowRays.origin[i], d / dist), dist - ShadowEpsilon))
+            radiance[shadowRays.sample[i]] += shadowRays.contribution[i];
+    }
+}
+
+void WavefrontIntegrator::compact()
+{
+    size_t live = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!paths.alive[i])
+            continue;
+        if (live != i) {
+            paths.origin[live] = paths.origin[i];
+            paths.direction[live] = paths.direction[i];
+            paths.throughput[live] = paths.throughput[i];
+            paths.sample[live] = paths.sample[i];
+            paths.depth[live] = paths.depth[i];
+            paths.bsdfPdf[live] = paths.bsdfPdf[i];
+            paths.samplerState[live] = paths.samplerState[i];
+            paths.alive[live] = 1;
+        }
+        ++live;
+    }
+    paths.resize(live);
+}
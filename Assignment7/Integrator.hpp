@@ -0,0 +1,98 @@
+//
+// Wavefront path tracer.
+//
+// Instead of following one path to the end recursively, a whole batch of
+// paths is advanced one bounce at a time. Every bounce runs the same stages
+// over all paths that are still alive:
+//
+//   extend  - find the closest hit of every path ray
+//   shade   - add emission, sample the light and pick the next direction
+//   connect - trace the shadow rays created by shade as occlusion queries
+//   compact - drop the paths that were terminated
+//
+// The path state lives in structure-of-arrays form so each stage streams
+// through the fields it needs.
+//
+#pragma once
+
+#include <vector>
+#include "Scene.hpp"
+#include "Vector.hpp"
+#include "Ray.hpp"
+#include "Intersection.hpp"
+#include "Sampler.hpp"
+
+// A camera ray together with the pixel and the per-pixel sample number that
+// select its sample dimensions.
+struct CameraSample
+{
+    Ray ray;
+    int pixel;
+    int index;
+};
+
+struct IntegratorOptions
+{
+    // sample diffuse bounces proportional to cos(theta) instead of uniformly
+    bool cosineSampling = true;
+    // weight light and BSDF samples with the power heuristic. Without it
+    // direct light comes from light samples only and BSDF rays that reach an
+    // emitter are dropped.
+    bool mis = true;
+};
+
+class WavefrontIntegrator
+{
+public:
+    WavefrontIntegrator(const Scene& scene, const Sampler& sampler,
+                        const IntegratorOptions& options = IntegratorOptions())
+        : scene(scene), sampler(sampler), options(options) {}
+
+    // Traces one path per camera sample and writes the radiance carried back
+    // along it to radiance[i].
+    void Render(const std::vector<CameraSample>& cameraSamples,
+                std::vector<Vector3f>& radiance);
+
+private:
+    // state of the paths that are still being traced
+    struct PathStates
+    {
+        std::vector<Vector3f> origin;
+        std::vector<Vector3f> direction;
+        std::vector<Vector3f> throughput;
+        // index of the camera ray the path belongs to
+        std::vector<int> sample;
+        std::vector<int> depth;
+        // solid angle pdf of the BSDF sample that produced direction
+        std::vector<float> bsdfPdf;
+        std::vector<SamplerState> samplerState;
+        std::vector<Intersection> hit;
+        std::vector<char> alive;
+
+        size_t size() const { return origin.size(); }
+        void resize(size_t n);
+    };
+
+    // shadow rays from the shading points towards the sampled light points
+    struct ShadowRays
+    {
+        std::vector<Vector3f> origin;
+        std::vector<Vector3f> target;
+        std::vector<Vector3f> contribution;
+        std::vector<int> sample;
+
+        size_t size() const { return origin.size(); }
+        void clear();
+    };
+
+    void extend();
+    void shade(std::vector<Vector3f>& radiance);
+    void connect(std::vector<Vector3f>& radiance);
+    void compact();
+
+    const Scene& scene;
+    const Sampler& sampler;
+    const IntegratorOptions options;
+    PathStates paths;
+    ShadowRays shadowRays;
+};
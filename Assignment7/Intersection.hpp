@@ -15,7 +15,9 @@ struct Intersection
         happened=false;
         coords=Vector3f();
         normal=Vector3f();
-        distance= std::numeric_limits<double>::max();
+        distance= std::numeric_limits<float>::max();
+        u = v = 0;
+        primId = -1;
         obj =nullptr;
         m=nullptr;
     }
@@ -24,7 +26,12 @@ struct Intersection
     Vector3f tcoords;
     Vector3f normal;
     Vector3f emit;
-    double distance;
+    // ray parameter t of the hit
+    float distance;
+    // barycentrics of a triangle hit, the point is (1-u-v)*v0 + u*v1 + v*v2
+    float u, v;
+    // index of the hit primitive in the list its BVH was built over
+    int primId;
     Object* obj;
     Material* m;
 };
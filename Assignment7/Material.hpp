@@ -101,10 +101,13 @@ public:
     inline Vector3f getEmission();
     inline bool hasEmission();
 
-    // sample a ray by Material properties
-    inline Vector3f sampleHemisphere(const Vector3f &wi, const Vector3f &N);
+    // sample a ray by Material properties, uniformly over the hemisphere or
+    // proportional to the cosine with N
+    inline Vector3f sampleHemisphere(const Vector3f &wi, const Vector3f &N, const Vector2f &u,
+                                     bool cosineWeighted = false);
     // given a ray, calculate the pdf of this ray
-    inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
+    inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N,
+                     bool cosineWeighted = false);
     // given a ray, calculate the contribution of this ray
     inline Vector3f eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
 
@@ -129,12 +132,19 @@ Vector3f Material::getColorAt(double u, double v) {
 }
 
 
-Vector3f Material::sampleHemisphere(const Vector3f &wi, const Vector3f &N){
+Vector3f Material::sampleHemisphere(const Vector3f &wi, const Vector3f &N, const Vector2f &u,
+                                    bool cosineWeighted){
     switch(m_type){
         case DIFFUSE:
         {
+            if (cosineWeighted) {
+                // uniform point on the unit disk projected up onto the hemisphere
+                float r = std::sqrt(u.x), phi = 2 * M_PI * u.y;
+                float z = std::sqrt(std::max(0.0f, 1.0f - u.x));
+                return toWorld(Vector3f(r * std::cos(phi), r * std::sin(phi), z), N);
+            }
             // uniform sample on the hemisphere
-            float x_1 = get_random_float(), x_2 = get_random_float();
+            float x_1 = u.x, x_2 = u.y;
             float z = std::fabs(1.0f - 2.0f * x_1);
             float r = std::sqrt(1.0f - z * z), phi = 2 * M_PI * x_2;
             Vector3f localRay(r*std::cos(phi), r*std::sin(phi), z);
@@ -146,10 +156,15 @@ Vector3f Material::sampleHemisphere(const Vector3f &wi, const Vector3f &N){
     throw("wrong type of material");
 }
 
-float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N,
+                    bool cosineWeighted){
     switch(m_type){
         case DIFFUSE:
         {
+            // cosine sample probability cos(theta) / PI
+            if (cosineWeighted)
+                return dotProduct(wo, N) > 0.0f ? std::max(0.0f, dotProduct(wi, N)) / M_PI
+                                                : 0.0f;
             // uniform sample probability 1 / (2 * PI)
             if (dotProduct(wo, N) > 0.0f)
                 return 0.5f / M_PI;
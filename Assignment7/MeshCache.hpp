@@ -0,0 +1,200 @@
+//
+// Binary cache of a parsed mesh, written next to the OBJ on first load.
+//
+// The file holds a fixed header followed by the raw arrays of a
+// TriangleMesh and, optionally, the flattened BVH built over it:
+//
+//   MeshCacheHeader
+//   positions    numVertices  x float[3]
+//   normals      numVertices  x float[3]   if MeshCacheHasNormals
+//   uvs          numVertices  x float[2]   if MeshCacheHasUVs
+//   indices      numTriangles x uint32[3]
+//   nodes        numNodes     x LinearBVHNode
+//   primitives   numTriangles x int32      if numNodes > 0
+//
+// Later loads map the file and copy the arrays straight into place, there is
+// nothing to parse. The cache is only used while the size and modification
+// time of the OBJ match the ones recorded in the header, and a BVH only if
+// it was built with the same settings. Data is in native byte order, the
+// cache is not meant to be moved between machines.
+//
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BVH.hpp"
+#include "MappedFile.hpp"
+#include "TriangleMesh.hpp"
+
+enum MeshCacheFlags : uint32_t
+{
+    MeshCacheHasNormals = 1,
+    MeshCacheHasUVs = 2
+};
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    // size and modification time of the OBJ the cache was made from
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t numVertices;
+    uint32_t numTriangles;
+    // 0 if no BVH is stored
+    uint32_t numNodes;
+    // settings the stored BVH was built with
+    uint32_t splitMethod;
+    uint32_t maxPrimsInNode;
+    uint32_t pad;
+};
+
+static const char kMeshCacheMagic[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+static const uint32_t kMeshCacheVersion = 1;
+
+inline std::string meshCachePath(const std::string& objPath) { return objPath + ".cache"; }
+
+// size and modification time identifying the current version of a file
+inline bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time)
+{
+    std::error_code ec;
+    size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return false;
+    auto written = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return false;
+    time = (int64_t)written.time_since_epoch().count();
+    return true;
+}
+
+// Loads the cache of objPath into mesh. If it also holds a BVH built with
+// the given settings, its nodes and leaf order are returned, otherwise they
+// are left empty. Returns false, with mesh unchanged, if there is no valid,
+// up to date cache.
+inline bool loadMeshCache(const std::string& objPath, BVHAccel::SplitMethod splitMethod,
+                          int maxPrimsInNode, TriangleMesh& mesh,
+                          std::vector<LinearBVHNode>& nodes, std::vector<int>& primitiveNumbers)
+{
+    uint64_t size;
+    int64_t time;
+    if (!sourceStamp(objPath, size, time))
+        return false;
+    MappedFile file(meshCachePath(objPath));
+    MeshCacheHeader header;
+    if (file.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kMeshCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != kMeshCacheVersion || header.sourceSize != size ||
+        header.sourceTime != time)
+        return false;
+
+    uint64_t nv = header.numVertices, nt = header.numTriangles, nn = header.numNodes;
+    bool hasNormals = header.flags & MeshCacheHasNormals;
+    bool hasUVs = header.flags & MeshCacheHasUVs;
+    uint64_t expected = sizeof(header) + nv * sizeof(Vector3f) +
+                        (hasNormals ? nv * sizeof(Vector3f) : 0) +
+                        (hasUVs ? nv * sizeof(Vector2f) : 0) + nt * 3 * sizeof(uint32_t) +
+                        nn * sizeof(LinearBVHNode) + (nn ? nt * sizeof(int) : 0);
+    if (file.size() != expected)
+        return false;
+
+    const char* p = file.data() + sizeof(header);
+    auto readArray = [&p](auto& array, uint64_t count) {
+        array.resize(count);
+        std::memcpy((void*)array.data(), p, count * sizeof(array[0]));
+        p += count * sizeof(array[0]);
+    };
+    // decoded aside so that a damaged cache leaves mesh untouched
+    TriangleMesh loaded;
+    readArray(loaded.positions, nv);
+    readArray(loaded.normals, hasNormals ? nv : 0);
+    readArray(loaded.uvs, hasUVs ? nv : 0);
+    readArray(loaded.indices, nt * 3);
+    for (uint32_t index : loaded.indices)
+        if (index >= nv)
+            return false;
+    std::swap(mesh, loaded);
+
+    nodes.clear();
+    primitiveNumbers.clear();
+    if (nn == 0 || header.splitMethod != (uint32_t)splitMethod ||
+        header.maxPrimsInNode != (uint32_t)maxPrimsInNode)
+        return true;
+    readArray(nodes, nn);
+    readArray(primitiveNumbers, nt);
+    // a damaged tree is dropped and rebuilt rather than trusted
+    bool valid = true;
+    for (uint64_t i = 0; i < nn && valid; ++i) {
+        const LinearBVHNode& node = nodes[i];
+        valid = node.nPrimitives > 0
+                    ? (uint64_t)node.primitivesOffset + node.nPrimitives <= nt
+                    : i + 1 < nn && node.secondChildOffset > (int)i &&
+                          (uint64_t)node.secondChildOffset < nn;
+    }
+    for (uint64_t i = 0; i < nt && valid; ++i)
+        valid = primitiveNumbers[i] >= 0 && (uint64_t)primitiveNumbers[i] < nt;
+    if (!valid) {
+        nodes.clear();
+        primitiveNumbers.clear();
+    }
+    return true;
+}
+
+// Writes the cache of objPath for mesh and, if given, the BVH built over it.
+// Failing to write (e.g. a read-only model directory) is not an error, the
+// next load just parses the OBJ again.
+inline bool saveMeshCache(const std::string& objPath, const TriangleMesh& mesh,
+                          const BVHAccel* bvh)
+{
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, kMeshCacheMagic, sizeof(header.magic));
+    header.version = kMeshCacheVersion;
+    if (!sourceStamp(objPath, header.sourceSize, header.sourceTime))
+        return false;
+    header.flags = (mesh.normals.empty() ? 0 : (uint32_t)MeshCacheHasNormals) |
+                   (mesh.uvs.empty() ? 0 : (uint32_t)MeshCacheHasUVs);
+    header.numVertices = (uint32_t)mesh.positions.size();
+    header.numTriangles = mesh.size();
+    if (bvh) {
+        header.numNodes = (uint32_t)bvh->nodes.size();
+        header.splitMethod = (uint32_t)bvh->splitMethod;
+        header.maxPrimsInNode = (uint32_t)bvh->maxPrimsInNode;
+    }
+
+    // write to a temporary name first so a concurrent load never sees a
+    // partial file
+    std::string path = meshCachePath(objPath), temp = path + ".tmp";
+    FILE* fp = fopen(temp.c_str(), "wb");
+    if (!fp)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    auto writeArray = [&](const auto& array) {
+        if (ok && !array.empty())
+            ok = fwrite(array.data(), sizeof(array[0]), array.size(), fp) == array.size();
+    };
+    writeArray(mesh.positions);
+    writeArray(mesh.normals);
+    writeArray(mesh.uvs);
+    writeArray(mesh.indices);
+    if (bvh && !bvh->nodes.empty()) {
+        writeArray(bvh->nodes);
+        writeArray(bvh->primitiveNumbers);
+    }
+    ok = fclose(fp) == 0 && ok;
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(temp, path, ec);
+    if (!ok || ec) {
+        std::filesystem::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
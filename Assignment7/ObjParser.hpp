@@ -0,0 +1,294 @@
+//
+// Parallel OBJ parser producing an indexed TriangleMesh.
+//
+// The file is mapped and cut into chunks at line boundaries, and the chunks
+// are parsed on the thread pool. Numbers are read with std::from_chars
+// straight from the mapped bytes. Each chunk collects its own vertex
+// attributes and face corners; the chunks are then concatenated and the
+// corners resolved into one index buffer.
+//
+// Supported are v, vt, vn and f statements with the v, v/vt, v//vn and
+// v/vt/vn corner forms, including negative (relative) indices. Polygons are
+// triangulated as fans, which is exact for the convex faces modelling tools
+// write. Everything else (groups, objects, materials, smoothing groups) is
+// ignored and all faces end up in the same mesh.
+//
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "TriangleMesh.hpp"
+
+namespace objparser {
+
+// Vertex attribute indices of one face corner, 0-based, -1 if absent.
+// Relative indices are first stored relative to the chunk and fixed up once
+// the number of attributes in earlier chunks is known.
+struct Corner
+{
+    int v = -1, vt = -1, vn = -1;
+    // bit k set: attribute k (v, vt, vn) is chunk relative
+    uint8_t relative = 0;
+};
+
+struct Chunk
+{
+    std::vector<Vector3f> positions, normals;
+    std::vector<Vector2f> uvs;
+    // three per triangle
+    std::vector<Corner> corners;
+    bool failed = false;
+};
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline const char* skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
+        ++p;
+    return p;
+}
+
+inline bool parseFloat(const char*& p, const char* end, float& value)
+{
+    p = skipBlanks(p, end);
+    // from_chars does not accept an explicit plus sign
+    if (p < end && *p == '+')
+        ++p;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+        return false;
+    p = result.ptr;
+    return true;
+}
+
+// One 1-based (or negative, relative) OBJ index, turned 0-based. count is
+// the number of such attributes read so far in the chunk.
+inline bool parseIndex(const char*& p, const char* end, int count, int& index, bool& relative)
+{
+    int value;
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc() || value == 0)
+        return false;
+    p = result.ptr;
+    relative = value < 0;
+    index = relative ? count + value : value - 1;
+    return true;
+}
+
+inline bool parseCorner(const char*& p, const char* end, const Chunk& chunk, Corner& corner)
+{
+    bool relative;
+    if (!parseIndex(p, end, (int)chunk.positions.size(), corner.v, relative))
+        return false;
+    corner.relative |= relative ? 1 : 0;
+    if (p == end || *p != '/')
+        return true;
+    ++p;
+    if (p < end && *p != '/') {
+        if (!parseIndex(p, end, (int)chunk.uvs.size(), corner.vt, relative))
+            return false;
+        corner.relative |= relative ? 2 : 0;
+    }
+    if (p == end || *p != '/')
+        return true;
+    ++p;
+    if (!parseIndex(p, end, (int)chunk.normals.size(), corner.vn, relative))
+        return false;
+    corner.relative |= relative ? 4 : 0;
+    return true;
+}
+
+inline bool parseLine(const char* p, const char* end, Chunk& chunk,
+                      std::vector<Corner>& polygon)
+{
+    p = skipBlanks(p, end);
+    if (p + 1 >= end)
+        return true;
+    if (p[0] == 'v' && isBlank(p[1])) {
+        float x, y, z;
+        p += 1;
+        if (!parseFloat(p, end, x) || !parseFloat(p, end, y) || !parseFloat(p, end, z))
+            return false;
+        chunk.positions.emplace_back(x, y, z);
+    }
+    else if (p[0] == 'v' && p[1] == 't' && p + 2 < end && isBlank(p[2])) {
+        float u, v = 0;
+        p += 2;
+        if (!parseFloat(p, end, u))
+            return false;
+        // the second coordinate is optional
+        parseFloat(p, end, v);
+        chunk.uvs.emplace_back(u, v);
+    }
+    else if (p[0] == 'v' && p[1] == 'n' && p + 2 < end && isBlank(p[2])) {
+        float x, y, z;
+        p += 2;
+        if (!parseFloat(p, end, x) || !parseFloat(p, end, y) || !parseFloat(p, end, z))
+            return false;
+        chunk.normals.emplace_back(x, y, z);
+    }
+    else if (p[0] == 'f' && isBlank(p[1])) {
+        polygon.clear();
+        p = skipBlanks(p + 1, end);
+        while (p < end) {
+            Corner corner;
+            if (!parseCorner(p, end, chunk, corner))
+                return false;
+            polygon.push_back(corner);
+            p = skipBlanks(p, end);
+        }
+        if (polygon.size() < 3)
+            return false;
+        for (size_t k = 1; k + 1 < polygon.size(); ++k) {
+            chunk.corners.push_back(polygon[0]);
+            chunk.corners.push_back(polygon[k]);
+            chunk.corners.push_back(polygon[k + 1]);
+        }
+    }
+    return true;
+}
+
+inline void parseChunk(const char* begin, const char* end, Chunk& chunk)
+{
+    std::vector<Corner> polygon;
+    for (const char* p = begin; p < end;) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+        // comments end at the line end as well
+        const char* hash = static_cast<const char*>(std::memchr(p, '#', eol - p));
+        if (!parseLine(p, hash ? hash : eol, chunk, polygon)) {
+            chunk.failed = true;
+            return;
+        }
+        p = eol + 1;
+    }
+}
+
+} // namespace objparser
+
+// Parses an OBJ file and appends its faces to mesh. Normals and texture
+// coordinates are kept if the file references any; if mesh already holds
+// faces with other attributes, the missing ones are zero filled. Returns
+// false if the file cannot be read or is malformed, mesh is unchanged then.
+inline bool parseOBJ(const std::string& path, TriangleMesh& mesh)
+{
+    using namespace objparser;
+    MappedFile file(path);
+    if (!file.data())
+        return false;
+
+    // about four chunks per thread so that uneven chunks still balance,
+    // but not so small that the per-chunk overhead shows
+    const char* data = file.data();
+    const size_t size = file.size();
+    ThreadPool& pool = globalThreadPool();
+    size_t chunkSize = std::max<size_t>(size / (4 * pool.size()), 1 << 16);
+    std::vector<std::pair<const char*, const char*>> ranges;
+    for (const char* begin = data; begin < data + size;) {
+        const char* end = begin + std::min(chunkSize, (size_t)(data + size - begin));
+        // extend to the end of the line
+        if (end < data + size) {
+            const char* eol = static_cast<const char*>(std::memchr(end, '\n', data + size - end));
+            end = eol ? eol + 1 : data + size;
+        }
+        ranges.emplace_back(begin, end);
+        begin = end;
+    }
+    std::vector<Chunk> chunks(ranges.size());
+    {
+        TaskGroup group(pool);
+        for (size_t c = 0; c < ranges.size(); ++c)
+            group.run([&, c] { parseChunk(ranges[c].first, ranges[c].second, chunks[c]); });
+        group.wait();
+    }
+
+    // concatenate the attributes, fixing up relative indices by the number
+    // of attributes of all earlier chunks
+    std::vector<Vector3f> positions, normals;
+    std::vector<Vector2f> uvs;
+    std::vector<Corner> corners;
+    for (Chunk& chunk : chunks) {
+        if (chunk.failed)
+            return false;
+        int offsets[3] = {(int)positions.size(), (int)uvs.size(), (int)normals.size()};
+        for (Corner& corner : chunk.corners) {
+            if (corner.relative & 1) corner.v += offsets[0];
+            if (corner.relative & 2) corner.vt += offsets[1];
+            if (corner.relative & 4) corner.vn += offsets[2];
+        }
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+        chunk = Chunk();
+    }
+
+    bool hasUVs = false, hasNormals = false;
+    for (const Corner& corner : corners) {
+        if (corner.v < 0 || corner.v >= (int)positions.size() ||
+            corner.vt >= (int)uvs.size() || corner.vn >= (int)normals.size() ||
+            (corner.relative & 2 && corner.vt < 0) || (corner.relative & 4 && corner.vn < 0))
+            return false;
+        hasUVs |= corner.vt >= 0;
+        hasNormals |= corner.vn >= 0;
+    }
+
+    // keep the attribute arrays of mesh the same length as its positions
+    const uint32_t first = (uint32_t)mesh.positions.size();
+    hasNormals |= !mesh.normals.empty();
+    hasUVs |= !mesh.uvs.empty();
+    if (hasNormals)
+        mesh.normals.resize(first);
+    if (hasUVs)
+        mesh.uvs.resize(first);
+
+    mesh.indices.reserve(mesh.indices.size() + corners.size());
+    if (!hasNormals && !hasUVs) {
+        // corners only reference positions, the OBJ indices are used as is
+        mesh.positions.insert(mesh.positions.end(), positions.begin(), positions.end());
+        for (const Corner& corner : corners)
+            mesh.indices.push_back(first + corner.v);
+        return true;
+    }
+
+    // one vertex per distinct combination of attributes
+    struct CornerHash
+    {
+        size_t operator()(const Corner& c) const
+        {
+            return ((size_t)c.v * 0x9e3779b97f4a7c15ull) ^ ((size_t)(c.vt + 1) * 0xc2b2ae3d27d4eb4full) ^
+                   (size_t)(c.vn + 1);
+        }
+    };
+    struct CornerEqual
+    {
+        bool operator()(const Corner& a, const Corner& b) const
+        {
+            return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+        }
+    };
+    std::unordered_map<Corner, uint32_t, CornerHash, CornerEqual> vertices;
+    vertices.reserve(positions.size());
+    for (Corner corner : corners) {
+        corner.relative = 0;
+        auto it = vertices.emplace(corner, (uint32_t)mesh.positions.size());
+        if (it.second) {
+            mesh.positions.push_back(positions[corner.v]);
+            if (hasNormals)
+                mesh.normals.push_back(corner.vn >= 0 ? normals[corner.vn] : Vector3f());
+            if (hasUVs)
+                mesh.uvs.push_back(corner.vt >= 0 ? uvs[corner.vt] : Vector2f());
+        }
+        mesh.indices.push_back(it.first->second);
+    }
+    return true;
+}
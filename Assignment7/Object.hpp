@@ -17,11 +17,17 @@ public:
     Object() {}
     virtual ~Object() {}
     virtual Intersection getIntersection(Ray _ray) = 0;
+    // occlusion query: true if the ray hits anything with 0 < t < tMax,
+    // stops at the first hit found instead of looking for the closest one
+    virtual bool hasIntersection(const Ray& ray, float tMax) = 0;
     virtual Vector3f evalDiffuseColor(const Vector2f &) const =0;
     virtual Bounds3 getBounds()=0;
     virtual float getArea()=0;
-    virtual void Sample(Intersection &pos, float &pdf)=0;
+    // picks a point on the surface from the uniform sample u in [0,1)^2,
+    // pdf is with respect to area
+    virtual void Sample(Intersection &pos, float &pdf, const Vector2f &u)=0;
     virtual bool hasEmit()=0;
+    virtual Vector3f getEmission()=0;
 };
 
 
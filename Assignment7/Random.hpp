@@ -0,0 +1,44 @@
+//
+// Counter-based random numbers.
+//
+// A stream is identified by (seed, pixel, sample) and every number it returns
+// is a hash of that key and a counter, so a value depends only on where it is
+// used and never on which thread draws it or in which order the tiles run.
+// The counter is the sample dimension, setDimension() jumps to any of them.
+//
+#pragma once
+
+#include <cstdint>
+#include "Vector.hpp"
+
+class RNG
+{
+public:
+    RNG() = default;
+    RNG(uint64_t seed, uint32_t pixel, uint32_t sample)
+        : key(mix(seed ^ mix(((uint64_t)pixel << 32) | sample))) {}
+
+    void setDimension(uint64_t dimension) { counter = dimension; }
+
+    // uniform in [0, 1)
+    float uniform() { return (next() >> 40) * 0x1p-24f; }
+    Vector2f uniform2D()
+    {
+        float x = uniform();
+        return Vector2f(x, uniform());
+    }
+
+private:
+    uint64_t next() { return mix(key + (counter++) * 0x9e3779b97f4a7c15ull); }
+
+    // SplitMix64 finalizer, a cheap full-avalanche 64 bit mix
+    static uint64_t mix(uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    uint64_t key = 0;
+    uint64_t counter = 0;
+};
@@ -1,106 +1,320 @@
 //
 // Created by goksu on 2/25/20.
 //
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include "Image.hpp"
 #include "Renderer.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
 
 inline float deg2rad(const float& deg) { return deg * M_PI / 180.0; }
 
 const float EPSILON = 0.00001;
 
+// PPM output is gamma corrected with an exponent of 0.6, PFM keeps the
+// linear radiance.
+static const GammaTable kOutputGamma(0.6f);
+
+Vector3f Renderer::pixelMean(int pixel) const
+{
+    return accumulation[pixel] / (float)std::max(pixelStats[pixel].n, 1);
+}
+
+void Renderer::writeOutput(const std::string& path, const Scene& scene) const
+{
+    std::vector<Vector3f> pixels(accumulation.size());
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = pixelMean(i);
+    if (!writeImage(path, pixels, scene.width, scene.height, kOutputGamma))
+        std::cerr << "Cannot write " << path << "\n";
+}
+
+// Checkpoint layout: magic, then the header from checkpointHeader() (version,
+// width, height, seed, sampler, spp, maxSpp, scene hash, flags, minSpp,
+// adaptive threshold bits), then the raw float RGB accumulation buffer and
+// the PixelStats of every pixel. The flags hold adaptive sampling, cosine
+// sampling and MIS, so every setting that decides which samples are taken
+// or what they contribute has to match for a resume.
+static const char kCheckpointMagic[4] = {'A', '7', 'C', 'K'};
+static const int32_t kCheckpointVersion = 6;
+
+enum CheckpointFlags : int32_t
+{
+    CheckpointAdaptive = 1,
+    CheckpointCosineSampling = 2,
+    CheckpointMIS = 4
+};
+
+// FNV-1a over the camera settings and the bounds, area and emission of every
+// object, so a checkpoint of a different scene is not resumed
+static uint32_t sceneHash(const Scene& scene)
+{
+    uint32_t hash = 2166136261u;
+    auto add = [&hash](const void* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= static_cast<const uint8_t*>(data)[i];
+            hash *= 16777619u;
+        }
+    };
+    add(&scene.fov, sizeof(scene.fov));
+    add(&scene.maxDepth, sizeof(scene.maxDepth));
+    add(&scene.RussianRoulette, sizeof(scene.RussianRoulette));
+    uint32_t numObjects = (uint32_t)scene.objects.size();
+    add(&numObjects, sizeof(numObjects));
+    for (Object* object : scene.objects) {
+        Bounds3 bounds = object->getBounds();
+        float area = object->getArea();
+        Vector3f emission = object->getEmission();
+        add(&bounds.pMin, sizeof(Vector3f));
+        add(&bounds.pMax, sizeof(Vector3f));
+        add(&area, sizeof(area));
+        add(&emission, sizeof(emission));
+    }
+    return hash;
+}
+
+Renderer::CheckpointHeader Renderer::checkpointHeader(const Scene& scene) const
+{
+    int32_t flags = (options.adaptive ? (int32_t)CheckpointAdaptive : 0) |
+                    (options.integrator.cosineSampling ? (int32_t)CheckpointCosineSampling : 0) |
+                    (options.integrator.mis ? (int32_t)CheckpointMIS : 0);
+    int32_t thresholdBits;
+    std::memcpy(&thresholdBits, &options.adaptiveThreshold, sizeof(thresholdBits));
+    return {kCheckpointVersion, scene.width, scene.height, (int32_t)options.seed,
+            (int32_t)options.sampler, options.spp, options.maxSpp,
+            (int32_t)sceneHash(scene), flags, options.minSpp, thresholdBits};
+}
+
+bool Renderer::loadCheckpoint(const Scene& scene)
+{
+    FILE* fp = fopen(options.checkpointPath.c_str(), "rb");
+    if (!fp)
+        return false;
+    char magic[4];
+    CheckpointHeader header;
+    bool ok = fread(magic, 1, 4, fp) == 4 && std::equal(magic, magic + 4, kCheckpointMagic) &&
+              fread(header.data(), sizeof(int32_t), header.size(), fp) == header.size() &&
+              header == checkpointHeader(scene);
+    std::vector<Vector3f> loaded(scene.width * scene.height);
+    std::vector<PixelStats> loadedStats(scene.width * scene.height);
+    ok = ok && fread(loaded.data(), sizeof(Vector3f), loaded.size(), fp) == loaded.size() &&
+         fread(loadedStats.data(), sizeof(PixelStats), loadedStats.size(), fp) ==
+             loadedStats.size();
+    fclose(fp);
+    if (!ok) {
+        std::cerr << "Ignoring checkpoint " << options.checkpointPath
+                  << ", it does not match this render\n";
+        return false;
+    }
+    accumulation.swap(loaded);
+    pixelStats.swap(loadedStats);
+    return true;
+}
+
+void Renderer::saveCheckpoint(const Scene& scene) const
+{
+    // write to a temporary file first so a kill during the write never
+    // destroys the previous checkpoint
+    std::string tmpPath = options.checkpointPath + ".tmp";
+    FILE* fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Cannot write " << tmpPath << "\n";
+        return;
+    }
+    CheckpointHeader header = checkpointHeader(scene);
+    bool ok = fwrite(kCheckpointMagic, 1, 4, fp) == 4 &&
+              fwrite(header.data(), sizeof(int32_t), header.size(), fp) == header.size() &&
+              fwrite(accumulation.data(), sizeof(Vector3f), accumulation.size(), fp) ==
+                  accumulation.size() &&
+              fwrite(pixelStats.data(), sizeof(PixelStats), pixelStats.size(), fp) ==
+                  pixelStats.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (ok)
+        ok = std::rename(tmpPath.c_str(), options.checkpointPath.c_str()) == 0;
+    if (!ok)
+        std::cerr << "Failed to write checkpoint " << options.checkpointPath << "\n";
+}
+
+bool Renderer::converged(const PixelStats& stats) const
+{
+    if (!options.adaptive || stats.n < options.minSpp)
+        return false;
+    // relative standard error of the mean; the floor keeps almost black
+    // pixels from being sampled forever
+    float standardError = std::sqrt(stats.variance() / stats.n);
+    return standardError <= options.adaptiveThreshold * std::max(stats.mean, 0.01f);
+}
+
 // The main render function. This where we iterate over all pixels in the image,
-// generate primary rays and cast these rays into the scene. The content of the
-// framebuffer is saved to a file.
+// generate primary rays and cast these rays into the scene. The image is
+// refined progressively: every pass adds up to options.passSpp samples to
+// each pixel that still needs them, then a preview and a checkpoint are saved.
 void Renderer::Render(const Scene& scene)
 {
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    if (!scene.bvh) {
+        std::cerr << "Scene::buildBVH() must be called before rendering\n";
+        return;
+    }
     float scale = tan(deg2rad(scene.fov * 0.5));
     float imageAspectRatio = scene.width / (float)scene.height;
     Vector3f eye_pos(278, 273, -800);
 
-    bool multithread = true;
+    int num_pixels = scene.width * scene.height;
+    accumulation.assign(num_pixels, Vector3f(0));
+    pixelStats.assign(num_pixels, PixelStats());
+    if (options.resume && !options.checkpointPath.empty() && loadCheckpoint(scene))
+        std::cout << "Resuming from " << options.checkpointPath << "\n";
 
-    if(!multithread)
-    {
-        // change the spp value to change sample ammount
-        spp = 128;
-        std::cout << "SPP: " << spp << "\n";
-        int m = 0;
-        for (uint32_t j = 0; j < scene.height; ++j) {
-            for (uint32_t i = 0; i < scene.width; ++i) {
-                // generate primary ray direction
-                float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                        imageAspectRatio * scale;
-                float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-                Vector3f dir = normalize(Vector3f(-x, y, 1));
-                for (int k = 0; k < spp; k++){
-                    framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp; 
-                    //std::cout<<framebuffer[m]<<"\n"; 
-                }
-                m++;
-                }
-                UpdateProgress(j/(float)scene.height);
-            }
-        UpdateProgress(1.f);
+    int spp = options.spp;
+    // without adaptive sampling every pixel simply gets spp samples
+    int maxSpp = options.adaptive ? std::max(options.maxSpp, spp) : spp;
+    int64_t budget = (int64_t)spp * num_pixels;
+    ThreadPool& pool = globalThreadPool();
+    std::unique_ptr<Sampler> sampler = makeSampler(options.sampler, options.seed);
+    std::cout << "SPP: " << spp << (options.adaptive ? " (adaptive)" : "")
+              << ", threads: " << pool.size() << "\n";
+
+    // every tile writes its own pixels of the shared accumulation buffer, so
+    // the workers never touch the same element. The scene is only read
+    // through the const reference captured below; it outlives the task group.
+    int tiles_x = (scene.width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (scene.height + TILE_SIZE - 1) / TILE_SIZE;
+    int num_tiles = tiles_x * tiles_y;
+    std::mutex progress_mutex;
+
+    std::string outputPath = options.outputPath;
+    if (outputPath.empty()) {
+        char filename[128];
+        snprintf(filename, sizeof(filename), "../images/binary_%dx%d_spp%d_thread%u.ppm",
+                 scene.width, scene.height, spp, pool.size());
+        outputPath = filename;
     }
-    else{
-        spp = 1024;
-        int m = 0;
-        int spp_each = spp/NUM_THREADS;
-        std::vector<Vector3f> framebuffer0(scene.width * scene.height);
-        std::vector<Vector3f> framebuffer1(scene.width * scene.height);
-        std::vector<Vector3f> framebuffer2(scene.width * scene.height);
-        std::vector<Vector3f> framebuffer3(scene.width * scene.height);
-        std::thread th0(thread_task, &framebuffer0, spp_each, spp, scene, eye_pos);
-        std::thread th1(thread_task, &framebuffer1, spp_each, spp, scene, eye_pos);
-        std::thread th2(thread_task, &framebuffer2, spp_each, spp, scene, eye_pos);
-        std::thread th3(thread_task, &framebuffer3, spp_each, spp, scene, eye_pos);
-        th0.join();
-        th1.join();
-        th2.join();
-        th3.join();
-        //collect information among frame buffers 
-        for (uint32_t j = 0; j < scene.height; ++j) {
-            for (uint32_t i = 0; i < scene.width; ++i) {
-                framebuffer[m] = framebuffer0[m]+framebuffer1[m]+framebuffer2[m]+framebuffer3[m];
-                m++;
+    // Once a pass is known to be the last one, the final image is streamed
+    // out tile by tile while the rest of the pass is traced. A pass is last
+    // if it uses up the budget or leaves every pixel at maxSpp or converged.
+    // A render that ends because the pixels converged during its last pass
+    // cannot be predicted, its image is written after the loop.
+    std::unique_ptr<ImageStream> output;
+
+    // samples every pixel receives in the coming pass, 0 if it is done
+    std::vector<int> passSamples(num_pixels);
+    while (true) {
+        int64_t used = 0, wanted = 0;
+        for (int p = 0; p < num_pixels; ++p) {
+            const PixelStats& stats = pixelStats[p];
+            used += stats.n;
+            passSamples[p] = converged(stats) ? 0
+                : std::min(std::max(options.passSpp, 1), maxSpp - stats.n);
+            passSamples[p] = std::max(passSamples[p], 0);
+            wanted += passSamples[p];
+        }
+        if (wanted == 0 || used >= budget)
+            break;
+        // spread what is left of the budget evenly over the last pass
+        if (used + wanted > budget) {
+            double fraction = (budget - used) / (double)wanted;
+            for (int p = 0; p < num_pixels; ++p)
+                if (passSamples[p] > 0)
+                    passSamples[p] = std::max(1, (int)(passSamples[p] * fraction));
+        }
+
+        int64_t passTotal = 0;
+        bool allFinal = true;
+        for (int p = 0; p < num_pixels; ++p) {
+            passTotal += passSamples[p];
+            allFinal &= passSamples[p] == 0 || pixelStats[p].n + passSamples[p] >= maxSpp;
+        }
+        bool lastPass = allFinal || used + passTotal >= budget;
+        if (lastPass) {
+            output = std::make_unique<ImageStream>(outputPath, scene.width, scene.height,
+                                                   kOutputGamma);
+            if (!output->isOpen()) {
+                std::cerr << "Cannot write " << outputPath << "\n";
+                output.reset();
             }
         }
+
+        {
+            stats::ScopedTimer timer("render");
+            std::atomic<int> tiles_done{0};
+            TaskGroup tiles(pool);
+            for (int t = 0; t < num_tiles; ++t) {
+                tiles.run([&, t] {
+                    int x0 = (t % tiles_x) * TILE_SIZE, y0 = (t / tiles_x) * TILE_SIZE;
+                    int x1 = std::min(x0 + TILE_SIZE, scene.width);
+                    int y1 = std::min(y0 + TILE_SIZE, scene.height);
+                    // the samples of the whole tile are traced as one wavefront
+                    std::vector<CameraSample> cameraSamples;
+                    for (int j = y0; j < y1; ++j) {
+                        for (int i = x0; i < x1; ++i) {
+                            int m = j * scene.width + i;
+                            // generate primary ray direction
+                            float x = (2 * (i + 0.5) / (float)scene.width - 1) *
+                                    imageAspectRatio * scale;
+                            float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
+
+                            Vector3f dir = normalize(Vector3f(-x, y, 1));
+                            // samples are numbered per pixel across passes, so a
+                            // resumed render draws the same numbers as a full one
+                            for (int k = 0; k < passSamples[m]; k++)
+                                cameraSamples.push_back({Ray(eye_pos, dir), m,
+                                                         pixelStats[m].n + k});
+                        }
+                    }
+                    std::vector<Vector3f> radiance;
+                    WavefrontIntegrator integrator(scene, *sampler, options.integrator);
+                    integrator.Render(cameraSamples, radiance);
+                    for (size_t k = 0; k < radiance.size(); ++k) {
+                        int m = cameraSamples[k].pixel;
+                        accumulation[m] += radiance[k];
+                        pixelStats[m].add(luminance(radiance[k]));
+                    }
+                    if (output) {
+                        // the tile is final, hand it to the I/O thread
+                        std::vector<Vector3f> pixels;
+                        pixels.reserve((x1 - x0) * (y1 - y0));
+                        for (int j = y0; j < y1; ++j)
+                            for (int i = x0; i < x1; ++i)
+                                pixels.push_back(pixelMean(j * scene.width + i));
+                        output->add(x0, y0, x1, y1, std::move(pixels));
+                    }
+                    int done = tiles_done.fetch_add(1) + 1;
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    UpdateProgress(std::min(1.0, (used + wanted * done / (double)num_tiles) / budget));
+                });
+            }
+            tiles.wait();
+        }
+
+        stats::ScopedTimer timer("checkpoint");
+        if (!options.previewPath.empty())
+            writeOutput(options.previewPath, scene);
+        if (!options.checkpointPath.empty())
+            saveCheckpoint(scene);
     }
-    // save framebuffer to file
-    // FILE* fp = fopen("../images/binary_784x784_spp32.ppm", "wb");
-    // FILE* fp = fopen("../images/binary_200x200_spp64.ppm", "wb");
-    // FILE* fp = fopen("../images/binary_300x300_spp1024.ppm", "wb");
-    // FILE* fp = fopen("../images/binary_84x84_spp64_thread4.ppm", "wb");
-    FILE* fp = fopen("../images/binary_784x784_spp1024_thread4.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
+    UpdateProgress(1.f);
+
+    int64_t total = 0;
+    int convergedPixels = 0;
+    for (const PixelStats& stats : pixelStats) {
+        total += stats.n;
+        convergedPixels += converged(stats);
     }
-    fclose(fp);    
-}
+    std::cout << "\nAverage spp: " << total / (double)num_pixels << ", converged pixels: "
+              << convergedPixels << " / " << num_pixels << "\n";
 
-void thread_task(std::vector<Vector3f> * framebuffer_ptr, int num_spp, int spp_tot, 
-                           Scene scene, Vector3f eye_pos)
-{
-    int m = 0;
-    float scale = tan(deg2rad(scene.fov * 0.5));
-    float imageAspectRatio = scene.width / (float)scene.height;
-    for (uint32_t j = 0; j < scene.height; ++j) {
-        for (uint32_t i = 0; i < scene.width; ++i) {
-            float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                    imageAspectRatio * scale;
-            float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-            Vector3f dir = normalize(Vector3f(-x, y, 1));
-            for (int k=0; k<num_spp; k++){
-                (*framebuffer_ptr)[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp_tot;
-                //std::cout<<(*framebuffer_ptr)[m]<<"\n";
-            }
-            m++;
-        }   
+    // save framebuffer to file, unless it was streamed out during the last pass
+    {
+        stats::ScopedTimer timer("output");
+        if (!output)
+            writeOutput(outputPath, scene);
+        else if (!output->finish())
+            std::cerr << "Cannot write " << outputPath << "\n";
     }
-}
\ No newline at end of file
+    // the render is complete, a later run must not resume from it
+    if (!options.checkpointPath.empty())
+        std::remove(options.checkpointPath.c_str());
+}
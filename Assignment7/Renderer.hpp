@@ -3,20 +3,96 @@
 //
 #pragma once
 
+#include <array>
 #include <thread>
 #include <fstream>
+#include <string>
+#include "Integrator.hpp"
+#include "Sampler.hpp"
 #include "Scene.hpp"
 #include "Vector.hpp"
 
-#define NUM_THREADS 4
+// the image is split into TILE_SIZE x TILE_SIZE tiles which are handed out to
+// the worker threads of the renderer
+#define TILE_SIZE 16
+
+// Settings of a progressive render. The image is refined in passes of
+// passSpp samples per pixel until spp samples are reached; after every pass
+// a preview image and a resumable checkpoint are written.
+//
+// With adaptive sampling spp * width * height is the sample budget of the
+// whole image instead. Pixels stop receiving samples once the relative
+// standard error of their mean luminance drops below adaptiveThreshold, and
+// the budget they leave over goes to the pixels that are still noisy.
+struct RenderOptions
+{
+    int spp = 1024;
+    int passSpp = 16;
+    bool adaptive = true;
+    float adaptiveThreshold = 0.01f;
+    // samples every pixel gets before it may be considered converged
+    int minSpp = 64;
+    // upper limit of samples for a single pixel
+    int maxSpp = 4096;
+    // final image, an empty path picks a name from resolution and spp;
+    // a .pfm path keeps the linear float radiance instead of 8-bit PPM,
+    // "-" streams the image to standard output
+    std::string outputPath;
+    // written after every pass, empty paths disable them
+    std::string previewPath = "../images/preview.ppm";
+    std::string checkpointPath = "../images/checkpoint.bin";
+    // continue from checkpointPath if it matches the scene and settings
+    bool resume = true;
+    // without adaptive sampling, renders with the same seed and settings are
+    // bit-identical whatever the pass size, thread count or resuming; with
+    // it, convergence is decided at pass boundaries, so the pass size
+    // changes which pixels get more samples
+    uint32_t seed = 0;
+    // Sobol reaches a given noise level with fewer samples
+    SamplerType sampler = SamplerType::Sobol;
+    // cosine-weighted BSDF sampling and MIS, see IntegratorOptions
+    IntegratorOptions integrator;
+};
+
+// Welford's running mean / variance of the sample luminance of one pixel.
+struct PixelStats
+{
+    float mean = 0, m2 = 0;
+    int32_t n = 0;
+
+    void add(float x)
+    {
+        n++;
+        float delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+    float variance() const { return n > 1 ? m2 / (n - 1) : 0.0f; }
+};
 
 class Renderer
 {
 public:
+    RenderOptions options;
+
     void Render(const Scene& scene);
 private:
-    int spp;
-};
+    // identifies the render a checkpoint belongs to, it is only resumed if
+    // the whole header matches
+    using CheckpointHeader = std::array<int32_t, 11>;
+    CheckpointHeader checkpointHeader(const Scene& scene) const;
+    bool loadCheckpoint(const Scene& scene);
+    void saveCheckpoint(const Scene& scene) const;
 
-void thread_task(std::vector<Vector3f> * framebuffer_ptr, int num_spp, int spp_tot,
-                     Scene scene, Vector3f eye_pos);
\ No newline at end of file
+    bool converged(const PixelStats& stats) const;
+
+    // mean of the samples taken so far
+    Vector3f pixelMean(int pixel) const;
+    // image of the pixel means, see writeImage() for the formats
+    void writeOutput(const std::string& path, const Scene& scene) const;
+
+    // sum of all samples taken so far for every pixel
+    std::vector<Vector3f> accumulation;
+    // running mean and variance of the luminance of every pixel
+    std::vector<PixelStats> pixelStats;
+};
@@ -0,0 +1,153 @@
+//
+// Samplers hand out the random dimensions of a path.
+//
+// A path keeps a small SamplerState (pixel, sample number, next dimension)
+// and asks the renderer's Sampler for one or two dimensions at a time. The
+// samplers themselves are stateless, so one instance is shared by all threads
+// and every value depends only on the state it is asked for.
+//
+//   IndependentSampler  plain uniform random numbers from RNG
+//   SobolSampler        Owen-scrambled Sobol points, see below
+//
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "Random.hpp"
+#include "Vector.hpp"
+
+enum class SamplerType { Independent, Sobol };
+
+struct SamplerState
+{
+    uint32_t pixel = 0;
+    uint32_t index = 0;
+    uint32_t dimension = 0;
+};
+
+class Sampler
+{
+public:
+    explicit Sampler(uint32_t seed) : seed(seed) {}
+    virtual ~Sampler() = default;
+
+    // both advance state.dimension past the values they return
+    virtual float get1D(SamplerState& state) const = 0;
+    virtual Vector2f get2D(SamplerState& state) const = 0;
+
+protected:
+    const uint32_t seed;
+};
+
+class IndependentSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    float get1D(SamplerState& state) const override
+    {
+        RNG rng(seed, state.pixel, state.index);
+        rng.setDimension(state.dimension++);
+        return rng.uniform();
+    }
+
+    Vector2f get2D(SamplerState& state) const override
+    {
+        RNG rng(seed, state.pixel, state.index);
+        rng.setDimension(state.dimension);
+        state.dimension += 2;
+        return rng.uniform2D();
+    }
+};
+
+// Padded 2D Sobol points with hash-based Owen scrambling (Burley 2020,
+// "Practical Hash-based Owen Scrambling"). Every 1D or 2D request uses the
+// first one or two Sobol dimensions, which are well stratified for any
+// number of samples. The sample order is shuffled and the points are
+// scrambled with a seed hashed from (seed, pixel, dimension), so different
+// dimensions and pixels are decorrelated.
+class SobolSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    float get1D(SamplerState& state) const override
+    {
+        uint32_t s = hash(seed, state.pixel, state.dimension++);
+        uint32_t i = nestedUniformScramble(state.index, s);
+        return toFloat(nestedUniformScramble(reverseBits(i), hashCombine(s, 0)));
+    }
+
+    Vector2f get2D(SamplerState& state) const override
+    {
+        uint32_t s = hash(seed, state.pixel, state.dimension);
+        state.dimension += 2;
+        uint32_t i = nestedUniformScramble(state.index, s);
+        uint32_t x = nestedUniformScramble(reverseBits(i), hashCombine(s, 0));
+        uint32_t y = nestedUniformScramble(sobolDimension1(i), hashCombine(s, 1));
+        return Vector2f(toFloat(x), toFloat(y));
+    }
+
+private:
+    static float toFloat(uint32_t x) { return (x >> 8) * 0x1p-24f; }
+
+    static uint32_t reverseBits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // second Sobol dimension, its direction numbers are Pascal's triangle
+    // mod 2: v[0] = 1 << 31, v[k] = v[k - 1] ^ (v[k - 1] >> 1)
+    static uint32_t sobolDimension1(uint32_t index)
+    {
+        uint32_t result = 0, v = 1u << 31;
+        for (; index; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                result ^= v;
+        return result;
+    }
+
+    // Laine-Karras style permutation, Owen scrambles the reversed bits
+    static uint32_t nestedUniformScramble(uint32_t x, uint32_t s)
+    {
+        x = reverseBits(x);
+        x += s;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverseBits(x);
+    }
+
+    static uint32_t hashCombine(uint32_t seed, uint32_t v)
+    {
+        return seed ^ (v + (seed << 6) + (seed >> 2));
+    }
+
+    // lowbias32 integer hash by Chris Wellons
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static uint32_t hash(uint32_t a, uint32_t b, uint32_t c)
+    {
+        return hash(hashCombine(hashCombine(hash(a), b), c));
+    }
+};
+
+inline std::unique_ptr<Sampler> makeSampler(SamplerType type, uint32_t seed)
+{
+    if (type == SamplerType::Independent)
+        return std::make_unique<IndependentSampler>(seed);
+    return std::make_unique<SobolSampler>(seed);
+}
@@ -5,10 +5,12 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include "Vector.hpp"
 #include "Object.hpp"
 #include "Light.hpp"
 #include "AreaLight.hpp"
+#include "AliasTable.hpp"
 #include "BVH.hpp"
 #include "Ray.hpp"
 
@@ -27,16 +29,39 @@ public:
     Scene(int w, int h) : width(w), height(h)
     {}
 
+    // The scene is built once in main() and then shared read-only by all
+    // render workers through a const reference, so it must never be copied.
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
     void Add(Object *object) { objects.push_back(object); }
     //void Add(std::unique_ptr<Light> light) { lights.push_back(std::move(light)); }
 
     const std::vector<Object*>& get_objects() const { return objects; }
     //const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection Intersect(const Ray& ray) const;
-    BVHAccel *bvh;
-    void buildBVH();
-    Vector3f castRay(const Ray &ray, int depth) const;
-    void sampleLight(Intersection &pos, float &pdf) const;
+    // occlusion query for shadow rays, true if anything is hit before tMax
+    bool IntersectP(const Ray& ray, float tMax) const;
+    // owned by the scene, (re)created by buildBVH()
+    std::unique_ptr<BVHAccel> bvh;
+    // builds the BVH and the emitter table
+    void buildBVH(BVHAccel::SplitMethod splitMethod = BVHAccel::SplitMethod::NAIVE);
+    // For the next frame of an animation, after the objects have been
+    // updated (MeshTriangle::update, Instance::setTransform): refits the BVH
+    // or rebuilds it if it degraded too much, see BVHAccel::update
+    void updateBVH(float maxCostRatio = BVHAccel::DefaultMaxCostRatio);
+    void buildEmitterTable();
+    void sampleLight(Intersection &pos, float &pdf, const Vector2f &u) const;
+    // area pdf of sampleLight() returning a point on the emitter hit by inter
+    float pdfLight(const Intersection &inter) const;
+
+    // Emitting objects and an alias table over their power (area times
+    // emitted luminance). sampleLight() picks an emitter from the table and
+    // then a point uniformly on its area, so every point is chosen with
+    // density luminance(emission) / emitterPower.
+    std::vector<Object*> emitters;
+    AliasTable emitterTable;
+    float emitterPower = 0;
     // std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
     //                                                const Vector3f &shadowPointOrig,
     //                                                const std::vector<Object *> &objects, uint32_t &index,
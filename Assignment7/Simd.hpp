@@ -0,0 +1,81 @@
+//
+// Minimal 4-wide float vector for the packet intersection kernels.
+//
+// Maps onto SSE on x86 (always available on x86-64) and falls back to plain
+// arrays elsewhere, which the compiler can still vectorize.
+//
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAYTRACING_SSE 1
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+
+struct float4
+{
+#ifdef RAYTRACING_SSE
+    __m128 v;
+    float4() = default;
+    float4(__m128 x) : v(x) {}
+    explicit float4(float x) : v(_mm_set1_ps(x)) {}
+    static float4 load(const float* p) { return _mm_load_ps(p); }
+    void store(float* p) const { _mm_store_ps(p, v); }
+
+    friend float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+    friend float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+    friend float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+    friend float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+    friend float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+    friend float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+    friend float4 abs(float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+    // comparisons return lane masks, combine them with & and |
+    friend float4 operator<(float4 a, float4 b) { return _mm_cmplt_ps(a.v, b.v); }
+    friend float4 operator<=(float4 a, float4 b) { return _mm_cmple_ps(a.v, b.v); }
+    friend float4 operator>(float4 a, float4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+    friend float4 operator>=(float4 a, float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+    friend float4 operator&(float4 a, float4 b) { return _mm_and_ps(a.v, b.v); }
+    friend float4 operator|(float4 a, float4 b) { return _mm_or_ps(a.v, b.v); }
+    // bit i is set if lane i of the mask is set
+    friend int movemask(float4 m) { return _mm_movemask_ps(m.v); }
+#else
+    float f[4];
+    float4() = default;
+    explicit float4(float x) : f{x, x, x, x} {}
+    static float4 load(const float* p) { float4 r; std::copy(p, p + 4, r.f); return r; }
+    void store(float* p) const { std::copy(f, f + 4, p); }
+
+    template <typename Op>
+    static float4 map(float4 a, float4 b, Op op)
+    {
+        float4 r;
+        for (int i = 0; i < 4; ++i) r.f[i] = op(a.f[i], b.f[i]);
+        return r;
+    }
+    static float mask(bool b) { union { unsigned u; float f; } m{b ? ~0u : 0u}; return m.f; }
+    static bool isSet(float x) { union { float f; unsigned u; } m{x}; return m.u != 0; }
+
+    friend float4 operator+(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x + y; }); }
+    friend float4 operator-(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x - y; }); }
+    friend float4 operator*(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x * y; }); }
+    friend float4 operator/(float4 a, float4 b) { return map(a, b, [](float x, float y) { return x / y; }); }
+    friend float4 min(float4 a, float4 b) { return map(a, b, [](float x, float y) { return y < x ? y : x; }); }
+    friend float4 max(float4 a, float4 b) { return map(a, b, [](float x, float y) { return y > x ? y : x; }); }
+    friend float4 abs(float4 a) { return map(a, a, [](float x, float) { return x < 0 ? -x : x; }); }
+
+    friend float4 operator<(float4 a, float4 b) { return map(a, b, [](float x, float y) { return mask(x < y); }); }
+    friend float4 operator<=(float4 a, float4 b) { return map(a, b, [](float x, float y) { return mask(x <= y); }); }
+    friend float4 operator>(float4 a, float4 b) { return map(a, b, [](float x, float y) { return mask(x > y); }); }
+    friend float4 operator>=(float4 a, float4 b) { return map(a, b, [](float x, float y) { return mask(x >= y); }); }
+    friend float4 operator&(float4 a, float4 b) { return map(a, b, [](float x, float y) { return mask(isSet(x) && isSet(y)); }); }
+    friend float4 operator|(float4 a, float4 b) { return map(a, b, [](float x, float y) { return mask(isSet(x) || isSet(y)); }); }
+    friend int movemask(float4 m)
+    {
+        int bits = 0;
+        for (int i = 0; i < 4; ++i) bits |= isSet(m.f[i]) << i;
+        return bits;
+    }
+#endif
+};
@@ -47,6 +47,18 @@ public:
 
     }
 
+    bool hasIntersection(const Ray& ray, float tMax)
+    {
+        Vector3f L = ray.origin - center;
+        float a = dotProduct(ray.direction, ray.direction);
+        float b = 2 * dotProduct(ray.direction, L);
+        float c = dotProduct(L, L) - radius2;
+        float t0, t1;
+        if (!solveQuadratic(a, b, c, t0, t1)) return false;
+        if (t0 < 0) t0 = t1;
+        return t0 >= 0 && t0 < tMax;
+    }
+
     // not used function here (only overide the base class)
     Vector3f evalDiffuseColor(const Vector2f &st)const {
         return Vector3f();
@@ -58,9 +70,9 @@ public:
                        Vector3f(center.x+radius, center.y+radius, center.z+radius));
     }
 
-    void Sample(Intersection &pos, float &pdf)
+    void Sample(Intersection &pos, float &pdf, const Vector2f &u)
     {
-        float theta = 2.0 * M_PI * get_random_float(), phi = M_PI * get_random_float();
+        float theta = 2.0 * M_PI * u.x, phi = M_PI * u.y;
         Vector3f dir(std::cos(phi), std::sin(phi)*std::cos(theta), std::sin(phi)*std::sin(theta));
         pos.coords = center + radius * dir;
         pos.normal = dir;
@@ -77,6 +89,11 @@ public:
     {
         return m->hasEmission();
     }
+
+    Vector3f getEmission()
+    {
+        return m->getEmission();
+    }
 };
 
 #endif //RAYTRACING_SPHERE_H
\ No newline at end of file
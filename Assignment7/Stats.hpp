@@ -0,0 +1,192 @@
+//
+// Render statistics: work counters and phase timers.
+//
+// Counters are kept per thread and only summed when a report is made, so
+// the hot paths never contend on a shared cache line. Code that increments
+// them in a loop should count into a local and add once at the end.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace stats {
+
+enum Counter
+{
+    CameraRays,
+    ExtensionRays,
+    ShadowRays,
+    BVHNodesVisited,
+    TriangleTests,
+    // shading points reached, summed over all paths
+    PathVertices,
+    Paths,
+    RussianRouletteTerminations,
+    NumCounters
+};
+
+inline const char* counterName(Counter c)
+{
+    static const char* names[NumCounters] = {
+        "camera_rays", "extension_rays", "shadow_rays", "bvh_nodes_visited",
+        "triangle_tests", "path_vertices", "paths", "russian_roulette_terminations"};
+    return names[c];
+}
+
+// The counters of one thread. Only the owner writes them; relaxed atomics
+// make reading them from the reporting thread well defined without adding a
+// locked instruction to every update.
+class ThreadCounters
+{
+public:
+    ThreadCounters()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        registry().push_back(this);
+    }
+    ~ThreadCounters()
+    {
+        // keep the counts of threads that exit before the report
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (int c = 0; c < NumCounters; ++c)
+            retired()[c] += values[c].load(std::memory_order_relaxed);
+        auto& all = registry();
+        for (size_t i = 0; i < all.size(); ++i)
+            if (all[i] == this) {
+                all[i] = all.back();
+                all.pop_back();
+                break;
+            }
+    }
+
+    void add(Counter c, uint64_t n)
+    {
+        values[c].store(values[c].load(std::memory_order_relaxed) + n,
+                        std::memory_order_relaxed);
+    }
+
+    static uint64_t total(Counter c)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        uint64_t sum = retired()[c];
+        for (const ThreadCounters* t : registry())
+            sum += t->values[c].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    std::atomic<uint64_t> values[NumCounters] = {};
+
+    // never destroyed: pool workers may still exit after static destructors
+    // have run
+    static std::vector<ThreadCounters*>& registry()
+    {
+        static auto* threads = new std::vector<ThreadCounters*>();
+        return *threads;
+    }
+    static uint64_t* retired()
+    {
+        static auto* counts = new uint64_t[NumCounters]();
+        return counts;
+    }
+    static std::mutex& registryMutex()
+    {
+        static auto* mutex = new std::mutex();
+        return *mutex;
+    }
+};
+
+inline void add(Counter c, uint64_t n = 1)
+{
+    thread_local ThreadCounters counters;
+    counters.add(c, n);
+}
+
+inline uint64_t total(Counter c) { return ThreadCounters::total(c); }
+
+// Wall time per named phase in seconds, accumulated over all timers of the
+// same name.
+class Phases
+{
+public:
+    static void add(const std::string& name, double seconds)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        times()[name] += seconds;
+    }
+    static std::map<std::string, double> snapshot()
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        return times();
+    }
+
+private:
+    static std::map<std::string, double>& times()
+    {
+        static std::map<std::string, double> phases;
+        return phases;
+    }
+    static std::mutex& mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+};
+
+// Adds the time from construction to destruction to a phase.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(std::string phase)
+        : phase(std::move(phase)), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { Phases::add(phase, elapsed()); }
+
+    double elapsed() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count();
+    }
+
+private:
+    std::string phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+// All counters, phase times and a few derived rates as a JSON object.
+inline std::string toJSON()
+{
+    std::string json = "{\n  \"counters\": {\n";
+    char line[128];
+    for (int c = 0; c < NumCounters; ++c) {
+        snprintf(line, sizeof(line), "    \"%s\": %llu%s\n", counterName((Counter)c),
+                 (unsigned long long)total((Counter)c), c + 1 < NumCounters ? "," : "");
+        json += line;
+    }
+    json += "  },\n  \"phases_ms\": {\n";
+    std::map<std::string, double> phases = Phases::snapshot();
+    size_t i = 0;
+    for (const auto& phase : phases) {
+        snprintf(line, sizeof(line), "    \"%s\": %.3f%s\n", phase.first.c_str(),
+                 phase.second * 1e3, ++i < phases.size() ? "," : "");
+        json += line;
+    }
+    uint64_t rays = total(CameraRays) + total(ExtensionRays) + total(ShadowRays);
+    double renderSeconds = phases.count("render") ? phases["render"] : 0.0;
+    uint64_t paths = total(Paths);
+    snprintf(line, sizeof(line), "  },\n  \"mrays_per_second\": %.3f,\n",
+             renderSeconds > 0 ? rays / renderSeconds * 1e-6 : 0.0);
+    json += line;
+    snprintf(line, sizeof(line), "  \"average_path_length\": %.3f\n}\n",
+             paths ? total(PathVertices) / (double)paths : 0.0);
+    json += line;
+    return json;
+}
+
+} // namespace stats
@@ -0,0 +1,225 @@
+//
+// Work-stealing thread pool used by the renderer and the BVH builder.
+//
+// Every worker owns a deque of tasks. A worker pushes and pops its own tasks
+// at the back (LIFO, good locality for nested work) and, once its deque is
+// empty, steals from the front of another worker's deque (FIFO, takes the
+// oldest and usually largest pieces of work).
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned num_threads = std::thread::hardware_concurrency())
+    {
+        if (num_threads == 0) num_threads = 1;
+        for (unsigned i = 0; i < num_threads; ++i)
+            queues.push_back(std::make_unique<WorkQueue>());
+        for (unsigned i = 0; i < num_threads; ++i)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    // Tasks submitted from a worker go to that worker's own deque, tasks
+    // submitted from outside the pool are spread round-robin.
+    void submit(Task task)
+    {
+        unsigned q = (worker_pool == this) ? worker_index
+                                           : next_queue.fetch_add(1) % size();
+        {
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            queues[q]->tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1);
+        {
+            // pairs with the predicate check in workerLoop so a worker that is
+            // about to sleep cannot miss this task
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_one();
+    }
+
+    // Runs one pending task on the calling thread if there is any. Used by
+    // threads that wait on a TaskGroup so they help instead of blocking.
+    bool runPendingTask()
+    {
+        Task task;
+        unsigned self = (worker_pool == this) ? worker_index : 0;
+        if (!popTask(self, task))
+            return false;
+        task();
+        return true;
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool popTask(unsigned self, Task& task)
+    {
+        // own queue first, newest task
+        {
+            WorkQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        // then steal the oldest task of some other worker
+        for (unsigned k = 1; k < size(); ++k) {
+            WorkQueue& victim = *queues[(self + k) % size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned index)
+    {
+        worker_pool = this;
+        worker_index = index;
+        Task task;
+        while (true) {
+            if (popTask(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{0};
+    std::atomic<unsigned> next_queue{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static inline thread_local ThreadPool* worker_pool = nullptr;
+    static inline thread_local unsigned worker_index = 0;
+};
+
+// A set of tasks that can be waited on together. The waiting thread keeps
+// executing pending pool tasks until every task of the group has finished,
+// and sleeps while there is nothing to help with.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& p) : pool(p) {}
+    // waits as well, but an exception of a task is only rethrown by wait()
+    ~TaskGroup() { waitAll(); }
+
+    template <typename F>
+    void run(F&& f)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+        }
+        pool.submit([this, task = std::forward<F>(f)]() mutable {
+            try {
+                task();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+            // counted down under the lock: a waiter only sees 0 once this
+            // task no longer touches the group, which it may then destroy
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                done.notify_all();
+        });
+    }
+
+    // Waits for all tasks and rethrows the first exception one of them threw.
+    void wait()
+    {
+        waitAll();
+        std::exception_ptr e;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(e, error);
+        }
+        if (e)
+            std::rethrow_exception(e);
+    }
+
+private:
+    void waitAll()
+    {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pending == 0)
+                    return;
+            }
+            if (pool.runPendingTask())
+                continue;
+            // the remaining tasks run on other threads; wake up now and then
+            // to help with tasks they submit
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait_for(lock, std::chrono::milliseconds(1), [this] { return pending == 0; });
+        }
+    }
+
+    ThreadPool& pool;
+    std::mutex mutex;
+    std::condition_variable done;
+    int pending = 0;
+    std::exception_ptr error;
+};
+
+// The process-wide pool shared by the BVH builder and the renderer, created
+// on first use with one worker per hardware thread.
+inline ThreadPool& globalThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
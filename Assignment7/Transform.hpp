@@ -0,0 +1,125 @@
+//
+// Affine transform, kept as a 3x4 matrix together with its inverse.
+//
+#pragma once
+
+#include <array>
+#include <cmath>
+#include "Bounds3.hpp"
+#include "Vector.hpp"
+
+class Transform
+{
+public:
+    Transform() : m(identity()), mInv(identity()) {}
+
+    static Transform translate(const Vector3f& t)
+    {
+        Matrix a = identity(), b = identity();
+        for (int i = 0; i < 3; ++i) {
+            a[i][3] = t[i];
+            b[i][3] = -t[i];
+        }
+        return Transform(a, b);
+    }
+
+    static Transform scale(const Vector3f& s)
+    {
+        Matrix a = identity(), b = identity();
+        for (int i = 0; i < 3; ++i) {
+            a[i][i] = s[i];
+            b[i][i] = 1 / s[i];
+        }
+        return Transform(a, b);
+    }
+
+    // counter-clockwise by degrees about axis, looking against the axis
+    static Transform rotate(float degrees, const Vector3f& axis)
+    {
+        Vector3f a = normalize(axis);
+        float theta = degrees * (float)M_PI / 180;
+        float s = std::sin(theta), c = std::cos(theta);
+        Matrix r = identity();
+        r[0][0] = a.x * a.x + (1 - a.x * a.x) * c;
+        r[0][1] = a.x * a.y * (1 - c) - a.z * s;
+        r[0][2] = a.x * a.z * (1 - c) + a.y * s;
+        r[1][0] = a.x * a.y * (1 - c) + a.z * s;
+        r[1][1] = a.y * a.y + (1 - a.y * a.y) * c;
+        r[1][2] = a.y * a.z * (1 - c) - a.x * s;
+        r[2][0] = a.x * a.z * (1 - c) - a.y * s;
+        r[2][1] = a.y * a.z * (1 - c) + a.x * s;
+        r[2][2] = a.z * a.z + (1 - a.z * a.z) * c;
+        // a rotation is inverted by its transpose
+        Matrix rInv = identity();
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                rInv[i][j] = r[j][i];
+        return Transform(r, rInv);
+    }
+
+    // applies t first, then this
+    Transform operator*(const Transform& t) const
+    {
+        return Transform(multiply(m, t.m), multiply(t.mInv, mInv));
+    }
+
+    Transform inverse() const { return Transform(mInv, m); }
+
+    Vector3f point(const Vector3f& p) const
+    {
+        return Vector3f(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    Vector3f vector(const Vector3f& v) const
+    {
+        return Vector3f(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // normals go through the inverse transpose; the result is not normalized
+    Vector3f normal(const Vector3f& n) const
+    {
+        return Vector3f(mInv[0][0] * n.x + mInv[1][0] * n.y + mInv[2][0] * n.z,
+                        mInv[0][1] * n.x + mInv[1][1] * n.y + mInv[2][1] * n.z,
+                        mInv[0][2] * n.x + mInv[1][2] * n.y + mInv[2][2] * n.z);
+    }
+
+    // box around the eight transformed corners of b
+    Bounds3 bounds(const Bounds3& b) const
+    {
+        Bounds3 result;
+        for (int k = 0; k < 8; ++k)
+            result = Union(result, point(Vector3f(k & 1 ? b.pMax.x : b.pMin.x,
+                                                  k & 2 ? b.pMax.y : b.pMin.y,
+                                                  k & 4 ? b.pMax.z : b.pMin.z)));
+        return result;
+    }
+
+private:
+    // the implicit last row is (0, 0, 0, 1)
+    using Matrix = std::array<std::array<float, 4>, 3>;
+
+    Transform(const Matrix& m, const Matrix& mInv) : m(m), mInv(mInv) {}
+
+    static Matrix identity()
+    {
+        Matrix a = {};
+        a[0][0] = a[1][1] = a[2][2] = 1;
+        return a;
+    }
+
+    static Matrix multiply(const Matrix& a, const Matrix& b)
+    {
+        Matrix r;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                r[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] +
+                          (j == 3 ? a[i][3] : 0.0f);
+        return r;
+    }
+
+    Matrix m, mInv;
+};
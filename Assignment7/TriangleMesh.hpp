@@ -0,0 +1,54 @@
+//
+// Indexed triangle list shared by a MeshTriangle and the BVH built over it.
+//
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Bounds3.hpp"
+#include "Vector.hpp"
+
+// Vertices are stored once and referenced by three indices per triangle in
+// counter-clockwise order. Per-triangle data (edges, normal, area) is derived
+// on demand; the BVH keeps its own SoA copy of what intersection needs.
+// Shading normals and texture coordinates are per vertex, and empty if the
+// source has none.
+struct TriangleMesh
+{
+    std::vector<Vector3f> positions;
+    std::vector<Vector3f> normals;
+    std::vector<Vector2f> uvs;
+    std::vector<uint32_t> indices;
+
+    uint32_t size() const { return (uint32_t)(indices.size() / 3); }
+
+    const Vector3f& vertex(uint32_t tri, int k) const
+    {
+        return positions[indices[3 * tri + k]];
+    }
+
+    Bounds3 bounds(uint32_t tri) const
+    {
+        return Union(Bounds3(vertex(tri, 0), vertex(tri, 1)), vertex(tri, 2));
+    }
+
+    Vector3f normal(uint32_t tri) const
+    {
+        const Vector3f& v0 = vertex(tri, 0);
+        return normalize(crossProduct(vertex(tri, 1) - v0, vertex(tri, 2) - v0));
+    }
+
+    float area(uint32_t tri) const
+    {
+        const Vector3f& v0 = vertex(tri, 0);
+        return crossProduct(vertex(tri, 1) - v0, vertex(tri, 2) - v0).norm() * 0.5f;
+    }
+
+    // uniformly distributed point on the triangle for u in [0,1)^2
+    Vector3f samplePoint(uint32_t tri, const Vector2f& u) const
+    {
+        float x = std::sqrt(u.x), y = u.y;
+        return vertex(tri, 0) * (1.0f - x) + vertex(tri, 1) * (x * (1.0f - y)) +
+               vertex(tri, 2) * (x * y);
+    }
+};
@@ -34,8 +34,8 @@ public:
     { return Vector3f(v.x * r, v.y * r, v.z * r); }
     friend std::ostream & operator << (std::ostream &os, const Vector3f &v)
     { return os << v.x << ", " << v.y << ", " << v.z; }
-    double       operator[](int index) const;
-    double&      operator[](int index);
+    float        operator[](int index) const;
+    float&       operator[](int index);
 
 
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2) {
@@ -48,7 +48,7 @@ public:
                        std::max(p1.z, p2.z));
     }
 };
-inline double Vector3f::operator[](int index) const {
+inline float Vector3f::operator[](int index) const {
     return (&x)[index];
 }
 
@@ -90,6 +90,10 @@ inline Vector3f crossProduct(const Vector3f &a, const Vector3f &b)
     );
 }
 
+// Rec. 709 luminance of a linear RGB color
+inline float luminance(const Vector3f &c)
+{ return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
+
 
 
 #endif //RAYTRACING_VECTOR_H
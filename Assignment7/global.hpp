@@ -1,7 +1,7 @@
 #pragma once
 #include <iostream>
 #include <cmath>
-#include <random>
+#include <limits>
 
 #undef M_PI
 #define M_PI 3.141592653589793f
@@ -28,15 +28,6 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
     return true;
 }
 
-inline float get_random_float()
-{
-    thread_local std::random_device dev;
-    thread_local std::mt19937 rng(dev());
-    thread_local std::uniform_real_distribution<float> dist(0.f, 1.f); 
-
-    return dist(rng);
-}
-
 inline void UpdateProgress(float progress)
 {
     int barWidth = 70;
@@ -1,10 +1,15 @@
+#include "Image.hpp"
 #include "Renderer.hpp"
 #include "Scene.hpp"
+#include "Stats.hpp"
 #include "Triangle.hpp"
 #include "Sphere.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
 #include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
 
 // In the main function of the program, we create the scene (create objects and
 // lights) as well as set the options for the render (image width and height,
@@ -12,6 +17,47 @@
 // function().
 int main(int argc, char** argv)
 {
+    Renderer r;
+    // command line: --spp N --pass N --output PATH|- --preview PATH
+    //               --checkpoint PATH --no-resume
+    //               --no-adaptive --threshold X --min-spp N --max-spp N
+    //               --seed N --sampler independent|sobol --no-cosine --no-mis
+    //               --stats PATH
+    std::string statsPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--spp" && hasValue) r.options.spp = std::atoi(argv[++i]);
+        else if (arg == "--pass" && hasValue) r.options.passSpp = std::atoi(argv[++i]);
+        else if (arg == "--output" && hasValue) r.options.outputPath = argv[++i];
+        else if (arg == "--preview" && hasValue) r.options.previewPath = argv[++i];
+        else if (arg == "--checkpoint" && hasValue) r.options.checkpointPath = argv[++i];
+        else if (arg == "--no-resume") r.options.resume = false;
+        else if (arg == "--no-adaptive") r.options.adaptive = false;
+        else if (arg == "--threshold" && hasValue) r.options.adaptiveThreshold = std::atof(argv[++i]);
+        else if (arg == "--min-spp" && hasValue) r.options.minSpp = std::atoi(argv[++i]);
+        else if (arg == "--max-spp" && hasValue) r.options.maxSpp = std::atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue) r.options.seed = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--stats" && hasValue) statsPath = argv[++i];
+        else if (arg == "--no-cosine") r.options.integrator.cosineSampling = false;
+        else if (arg == "--no-mis") r.options.integrator.mis = false;
+        else if (arg == "--sampler" && hasValue) {
+            std::string name = argv[++i];
+            if (name == "independent") r.options.sampler = SamplerType::Independent;
+            else if (name == "sobol") r.options.sampler = SamplerType::Sobol;
+            else {
+                std::cerr << "Unknown sampler " << name << "\n";
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "Unknown argument " << arg << "\n";
+            return 1;
+        }
+    }
+    // an image streamed to standard output must not be mixed with text
+    if (r.options.outputPath == "-")
+        imageStdout();
 
     // Change the definition here to change resolution
     Scene scene(784, 784);
@@ -25,12 +71,12 @@ int main(int argc, char** argv)
     Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
     light->Kd = Vector3f(0.65f);
 
-    MeshTriangle floor("../models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white);
-    MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("../models/cornellbox/left.obj", red);
-    MeshTriangle right("../models/cornellbox/right.obj", green);
-    MeshTriangle light_("../models/cornellbox/light.obj", light);
+    MeshTriangle floor("../models/cornellbox/floor.obj", white, BVHAccel::SplitMethod::SAH);
+    MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white, BVHAccel::SplitMethod::SAH);
+    MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white, BVHAccel::SplitMethod::SAH);
+    MeshTriangle left("../models/cornellbox/left.obj", red, BVHAccel::SplitMethod::SAH);
+    MeshTriangle right("../models/cornellbox/right.obj", green, BVHAccel::SplitMethod::SAH);
+    MeshTriangle light_("../models/cornellbox/light.obj", light, BVHAccel::SplitMethod::SAH);
 
     scene.Add(&floor);
     scene.Add(&shortbox);
@@ -39,18 +85,24 @@ int main(int argc, char** argv)
     scene.Add(&right);
     scene.Add(&light_);
 
-    scene.buildBVH();
-
-    Renderer r;
+    scene.buildBVH(BVHAccel::SplitMethod::SAH);
 
-    auto start = std::chrono::system_clock::now();
+    auto start = std::chrono::steady_clock::now();
     r.Render(scene);
-    auto stop = std::chrono::system_clock::now();
+    auto stop = std::chrono::steady_clock::now();
 
     std::cout << "Render complete: \n";
-    std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
-    std::cout << "          : " << std::chrono::duration_cast<std::chrono::minutes>(stop - start).count() << " minutes\n";
-    std::cout << "          : " << std::chrono::duration_cast<std::chrono::seconds>(stop - start).count() << " seconds\n";
+    std::cout << "Time taken: " << std::chrono::duration<double>(stop - start).count() << " seconds\n";
+
+    // work counters and phase timers, also written to --stats PATH if given
+    std::string json = stats::toJSON();
+    std::cout << json;
+    if (!statsPath.empty()) {
+        std::ofstream out(statsPath);
+        out << json;
+        if (!out)
+            std::cerr << "Cannot write " << statsPath << "\n";
+    }
 
     return 0;
 }
\ No newline at end of file